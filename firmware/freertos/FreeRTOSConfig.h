@@ -54,9 +54,23 @@
 #define configUSE_TICK_HOOK				0
 #define configCPU_CLOCK_HZ				( 38400000 )
 #define configTICK_RATE_HZ				( ( TickType_t ) 1000 )
+/* Tick is suppressed in longer idle times by the SysTick based
+   vPortSuppressTicksAndSleep of the port, which sleeps in EM1.
+   idle_sleep in main.c calls it and counts the sleeps. */
+#define configUSE_TICKLESS_IDLE			1
+void idle_sleep(uint32_t expected_ticks);
+void vPortSuppressTicksAndSleep(uint32_t xExpectedIdleTime);
+void idle_sleep_enter(void);
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime ) idle_sleep( xExpectedIdleTime )
+#define configPRE_SLEEP_PROCESSING( x ) idle_sleep_enter()
 #define configMAX_PRIORITIES			( 5 )
 #define configMINIMAL_STACK_SIZE		( ( unsigned short ) 32 )
+#if SIM
+/* Pointers in kernel objects are twice as large on the host simulator */
+#define configTOTAL_HEAP_SIZE			( ( size_t ) ( 32 * 1024 ) )
+#else
 #define configTOTAL_HEAP_SIZE			( ( size_t ) ( 16 * 1024 ) )
+#endif
 #define configMAX_TASK_NAME_LEN			( 10 )
 #define configUSE_TRACE_FACILITY		1
 #define configUSE_16_BIT_TICKS			0
@@ -139,5 +153,29 @@ standard names. */
 #define xPortPendSVHandler PendSV_Handler
 #define xPortSysTickHandler SysTick_Handler
 
+/* Binary trace hooks, see trace.h.
+ * These are expanded inside tasks.c and queue.c,
+ * so they can use the kernel's own variables. */
+#if TRACE
+#include "trace.h"
+#define traceTASK_CREATE( pxNewTCB ) \
+	trace_name( TRACE_TASK_NAME, ( pxNewTCB )->uxTCBNumber, \
+		strlen( ( pxNewTCB )->pcTaskName ), ( pxNewTCB )->pcTaskName )
+#define traceTASK_SWITCHED_IN() \
+	trace_event( TRACE_TASK_SWITCH, pxCurrentTCB->uxTCBNumber, 0 )
+#define traceQUEUE_CREATE( pxNewQueue ) \
+	( pxNewQueue )->uxQueueNumber = trace_queue_create( ( pxNewQueue )->ucQueueType )
+#define traceQUEUE_SEND( pxQueue ) \
+	trace_event( TRACE_QUEUE_SEND, ( pxQueue )->uxQueueNumber, ( pxQueue )->ucQueueType )
+#define traceQUEUE_SEND_FROM_ISR( pxQueue ) traceQUEUE_SEND( pxQueue )
+#define traceQUEUE_SEND_FAILED( pxQueue ) \
+	trace_event( TRACE_QUEUE_SEND_FAILED, ( pxQueue )->uxQueueNumber, ( pxQueue )->ucQueueType )
+#define traceQUEUE_SEND_FROM_ISR_FAILED( pxQueue ) traceQUEUE_SEND_FAILED( pxQueue )
+#define traceTASK_NOTIFY() \
+	trace_event( TRACE_NOTIFY, pxTCB->uxTCBNumber, 0 )
+#define traceTASK_NOTIFY_FROM_ISR() traceTASK_NOTIFY()
+#define traceTASK_NOTIFY_GIVE_FROM_ISR() traceTASK_NOTIFY()
+#endif
+
 #endif /* FREERTOS_CONFIG_H */
 
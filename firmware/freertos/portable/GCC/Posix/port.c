@@ -0,0 +1,393 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * FreeRTOS port for running the firmware on a POSIX host.
+ *
+ * Every task runs in its own thread, but only one of them runs at a
+ * time: the others wait on a semaphore of their own, and a context
+ * switch posts the semaphore of the next task before waiting on its own.
+ *
+ * Interrupts are simulated with a signal sent to the thread of the
+ * running task, so an interrupt handler preempts the task the same way
+ * as on the device. Another thread, such as a simulated timer, sets
+ * the interrupt pending and sends the signal. Disabling interrupts
+ * blocks the signal. A context switch requested by a handler is done
+ * when the handler returns, which is what PendSV does on the device.
+ *
+ * The stack given to a task by the kernel only holds the thread
+ * bookkeeping, and the task itself runs on the stack of its thread,
+ * so stack usage on the host says nothing about the device.
+ *
+ * 1 tab == 4 spaces!
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Scheduler includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Signal used to deliver interrupts. */
+#define portINTERRUPT_SIGNAL	SIGUSR1
+
+/* Bookkeeping of a task thread, kept at the top of the task stack. */
+typedef struct
+{
+	pthread_t xThread;
+	/* Posted to let the thread run. */
+	sem_t xResume;
+	/* Set while the thread owns the simulated processor. */
+	atomic_int xRunning;
+	TaskFunction_t pxCode;
+	void *pvParameters;
+} Thread_t;
+
+/* pxTopOfStack, the first member of the TCB, points to the Thread_t. */
+extern void * volatile pxCurrentTCB;
+#define prvThreadOfTCB( pxTCB )	( *( Thread_t ** ) ( pxTCB ) )
+
+/* Critical nesting is only counted in task context. It starts from a
+non-zero value so that critical sections used by the kernel before the
+scheduler starts do not enable interrupts. */
+static volatile UBaseType_t uxCriticalNesting = 0xaaaaaaaa;
+
+/* Set when a context switch is needed once the current interrupt
+handler returns or the current critical section is left. */
+static volatile BaseType_t xSwitchPending = pdFALSE;
+
+static volatile BaseType_t xSchedulerRunning = pdFALSE;
+
+/* Thread that owns the simulated processor, target of the signal. */
+static Thread_t * volatile pxRunningThread = NULL;
+
+static atomic_uint_least32_t ulPendingInterrupts;
+static void ( *pvInterruptHandlers[ portMAX_INTERRUPTS ] )( void );
+
+static sigset_t xInterruptSignal;
+
+/* Thread of the calling task, NULL in other threads. */
+static __thread Thread_t *pxThisThread = NULL;
+/* Set while an interrupt handler runs in this thread. */
+static __thread BaseType_t xThisInIsr = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+static void prvWaitToRun( Thread_t *pxThread )
+{
+	while( sem_wait( &pxThread->xResume ) != 0 )
+	{
+		/* Interrupted by a signal which was not for this thread. */
+		configASSERT( errno == EINTR );
+	}
+	atomic_store( &pxThread->xRunning, 1 );
+
+	/* An interrupt raised while the processor was changing hands was
+	sent to a thread that did not handle it, so handle it here once
+	the signal is unblocked. */
+	if( atomic_load( &ulPendingInterrupts ) != 0 )
+	{
+		pthread_kill( pthread_self(), portINTERRUPT_SIGNAL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+/* Hand the processor to the thread of pxCurrentTCB.
+Called with interrupts disabled. */
+static void prvSwitchThread( void )
+{
+	Thread_t *pxFrom = pxThisThread;
+	Thread_t *pxTo = prvThreadOfTCB( pxCurrentTCB );
+
+	if( pxTo == pxFrom )
+	{
+		return;
+	}
+	atomic_store( &pxFrom->xRunning, 0 );
+	pxRunningThread = pxTo;
+	sem_post( &pxTo->xResume );
+	prvWaitToRun( pxFrom );
+}
+/*-----------------------------------------------------------*/
+
+static void *prvThreadStart( void *pvArg )
+{
+	Thread_t *pxThread = ( Thread_t * ) pvArg;
+
+	pxThisThread = pxThread;
+	prvWaitToRun( pxThread );
+	/* Name the thread after its task for debuggers. */
+	pthread_setname_np( pthread_self(), pcTaskGetName( NULL ) );
+	pthread_sigmask( SIG_UNBLOCK, &xInterruptSignal, NULL );
+
+	pxThread->pxCode( pxThread->pvParameters );
+
+	/* Tasks must not return. */
+	configASSERT( 0 );
+	return NULL;
+}
+/*-----------------------------------------------------------*/
+
+StackType_t *pxPortInitialiseStack( StackType_t *pxTopOfStack, TaskFunction_t pxCode, void *pvParameters )
+{
+	Thread_t *pxThread;
+	sigset_t xOldMask;
+
+	pxThread = ( Thread_t * ) ( ( ( uintptr_t ) pxTopOfStack - sizeof( Thread_t ) ) & ~( uintptr_t ) 15 );
+	pxThread->pxCode = pxCode;
+	pxThread->pvParameters = pvParameters;
+	atomic_init( &pxThread->xRunning, 0 );
+	sem_init( &pxThread->xResume, 0, 0 );
+
+	/* The thread starts with the signal blocked and waits to be run. */
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, &xOldMask );
+	if( pthread_create( &pxThread->xThread, NULL, prvThreadStart, pxThread ) != 0 )
+	{
+		perror( "pthread_create" );
+		abort();
+	}
+	pthread_sigmask( SIG_SETMASK, &xOldMask, NULL );
+
+	return ( StackType_t * ) pxThread;
+}
+/*-----------------------------------------------------------*/
+
+static void prvInterruptSignalHandler( int iSignal )
+{
+	Thread_t *pxThread = pxThisThread;
+	uint32_t ulPending, ulInterrupt;
+	int iSavedErrno = errno;
+
+	( void ) iSignal;
+
+	/* A thread which has just given the processor away
+	does not run handlers, the next one will. */
+	if( pxThread == NULL || atomic_load( &pxThread->xRunning ) == 0 )
+	{
+		return;
+	}
+
+	xThisInIsr = pdTRUE;
+	while( ( ulPending = atomic_exchange( &ulPendingInterrupts, 0 ) ) != 0 )
+	{
+		for( ulInterrupt = 0; ulInterrupt < portMAX_INTERRUPTS; ulInterrupt++ )
+		{
+			if( ( ( ulPending >> ulInterrupt ) & 1 ) != 0 && pvInterruptHandlers[ ulInterrupt ] != NULL )
+			{
+				pvInterruptHandlers[ ulInterrupt ]();
+			}
+		}
+	}
+	xThisInIsr = pdFALSE;
+
+	if( xSwitchPending != pdFALSE )
+	{
+		xSwitchPending = pdFALSE;
+		vTaskSwitchContext();
+		prvSwitchThread();
+	}
+	errno = iSavedErrno;
+}
+/*-----------------------------------------------------------*/
+
+static void prvTickHandler( void )
+{
+	if( xTaskIncrementTick() != pdFALSE )
+	{
+		xSwitchPending = pdTRUE;
+	}
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortStartScheduler( void )
+{
+	struct sigaction xAction = { 0 };
+	Thread_t *pxFirst;
+
+	xAction.sa_handler = prvInterruptSignalHandler;
+	xAction.sa_flags = SA_RESTART;
+	sigemptyset( &xAction.sa_mask );
+	sigaddset( &xAction.sa_mask, portINTERRUPT_SIGNAL );
+	sigaction( portINTERRUPT_SIGNAL, &xAction, NULL );
+	pvInterruptHandlers[ portINTERRUPT_TICK ] = prvTickHandler;
+
+	/* The calling thread keeps interrupts disabled and only waits. */
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, NULL );
+	uxCriticalNesting = 0;
+	xSchedulerRunning = pdTRUE;
+
+	pxFirst = prvThreadOfTCB( pxCurrentTCB );
+	pxRunningThread = pxFirst;
+	sem_post( &pxFirst->xResume );
+
+	for( ;; )
+	{
+		pause();
+	}
+	return 0;
+}
+/*-----------------------------------------------------------*/
+
+void vPortEndScheduler( void )
+{
+	/* Not implemented, the simulator exits the process instead. */
+	configASSERT( 0 );
+}
+/*-----------------------------------------------------------*/
+
+void vPortSetInterruptHandler( uint32_t ulInterruptNumber, void ( *pvHandler )( void ) )
+{
+	configASSERT( ulInterruptNumber < portINTERRUPT_TICK );
+	pvInterruptHandlers[ ulInterruptNumber ] = pvHandler;
+}
+/*-----------------------------------------------------------*/
+
+/* Set an interrupt pending. Returns pdFALSE if it already was,
+which means the previous one has not been handled yet. */
+BaseType_t xPortGenerateSimulatedInterrupt( uint32_t ulInterruptNumber )
+{
+	uint32_t ulBit = 1UL << ulInterruptNumber;
+	uint32_t ulPrevious = atomic_fetch_or( &ulPendingInterrupts, ulBit );
+	Thread_t *pxThread = pxRunningThread;
+
+	if( pxThread != NULL )
+	{
+		pthread_kill( pxThread->xThread, portINTERRUPT_SIGNAL );
+	}
+	return ( ulPrevious & ulBit ) == 0;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortInterruptsPending( void )
+{
+	return atomic_load( &ulPendingInterrupts ) != 0;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortSchedulerRunning( void )
+{
+	return xSchedulerRunning;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortInIsr( void )
+{
+	return xThisInIsr;
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield( void )
+{
+	sigset_t xOldMask;
+
+	if( xThisInIsr != pdFALSE || uxCriticalNesting != 0 )
+	{
+		/* Switch once the handler returns or the critical section is left. */
+		xSwitchPending = pdTRUE;
+		return;
+	}
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, &xOldMask );
+	vTaskSwitchContext();
+	prvSwitchThread();
+	pthread_sigmask( SIG_SETMASK, &xOldMask, NULL );
+}
+/*-----------------------------------------------------------*/
+
+void vPortYieldFromISR( void )
+{
+	vPortYield();
+}
+/*-----------------------------------------------------------*/
+
+/* Disable interrupts and return 1 if they already were disabled. */
+uint32_t ulPortSetInterruptMask( void )
+{
+	sigset_t xOldMask;
+
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, &xOldMask );
+	return sigismember( &xOldMask, portINTERRUPT_SIGNAL ) == 1;
+}
+/*-----------------------------------------------------------*/
+
+/* Enable interrupts unless ulMask is from a call which found them disabled. */
+void vPortClearInterruptMask( uint32_t ulMask )
+{
+	if( ulMask == 0 )
+	{
+		pthread_sigmask( SIG_UNBLOCK, &xInterruptSignal, NULL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnterCritical( void )
+{
+	( void ) ulPortSetInterruptMask();
+	if( xThisInIsr == pdFALSE )
+	{
+		uxCriticalNesting++;
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortExitCritical( void )
+{
+	if( xThisInIsr != pdFALSE )
+	{
+		/* Interrupts stay disabled until the handler returns. */
+		return;
+	}
+	configASSERT( uxCriticalNesting );
+	uxCriticalNesting--;
+	if( uxCriticalNesting == 0 )
+	{
+		if( xSwitchPending != pdFALSE )
+		{
+			xSwitchPending = pdFALSE;
+			vTaskSwitchContext();
+			prvSwitchThread();
+		}
+		vPortClearInterruptMask( 0 );
+	}
+}
+/*-----------------------------------------------------------*/
+
+/* Called by the idle task with the scheduler suspended. The tick is
+not suppressed, so this only waits for the next interrupt like WFI. */
+void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+{
+	sigset_t xOldMask;
+	TickType_t xModifiableIdleTime;
+
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, &xOldMask );
+	if( eTaskConfirmSleepModeStatus() != eAbortSleep )
+	{
+		/* Same sleep processing hooks as in the Cortex-M ports. */
+		xModifiableIdleTime = xExpectedIdleTime;
+		configPRE_SLEEP_PROCESSING( xModifiableIdleTime );
+		if( xModifiableIdleTime > 0 )
+		{
+			sigsuspend( &xOldMask );
+		}
+		configPOST_SLEEP_PROCESSING( xExpectedIdleTime );
+	}
+	pthread_sigmask( SIG_SETMASK, &xOldMask, NULL );
+}
+/*-----------------------------------------------------------*/
+
+/* Runs before main, so that the signal set is ready
+when the first task is created. */
+__attribute__(( constructor )) static void prvPortInit( void )
+{
+	sigemptyset( &xInterruptSignal );
+	sigaddset( &xInterruptSignal, portINTERRUPT_SIGNAL );
+	atomic_init( &ulPendingInterrupts, 0 );
+}
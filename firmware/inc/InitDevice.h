@@ -34,7 +34,6 @@ extern void I2C0_enter_DefaultMode_from_RESET(void);
 extern void GPCRC_enter_DefaultMode_from_RESET(void);
 extern void LDMA_enter_DefaultMode_from_RESET(void);
 extern void TIMER0_enter_DefaultMode_from_RESET(void);
-extern void TIMER1_enter_DefaultMode_from_RESET(void);
 extern void LETIMER0_enter_DefaultMode_from_RESET(void);
 extern void CRYOTIMER_enter_DefaultMode_from_RESET(void);
 extern void PCNT0_enter_DefaultMode_from_RESET(void);
@@ -47,11 +46,9 @@ extern void PORTIO_enter_DefaultMode_from_RESET(void);
 #if KAPULA_v1
 	#define ENC1_PIN            (11)
 	#define ENC1_PORT           (gpioPortD)
-	#define ENC1_TIM1_CC0       TIMER_ROUTELOC0_CC0LOC_LOC19
 
 	#define ENC2_PIN            (12)
 	#define ENC2_PORT           (gpioPortD)
-	#define ENC2_TIM1_CC1       TIMER_ROUTELOC0_CC1LOC_LOC19
 
 	#define ENCP_PIN            (13)
 	#define ENCP_PORT           (gpioPortD)
@@ -70,11 +67,9 @@ extern void PORTIO_enter_DefaultMode_from_RESET(void);
 #elif KAPULA_v2
 	#define ENC1_PIN            (5)
 	#define ENC1_PORT           (gpioPortF)
-	#define ENC1_TIM1_CC0       TIMER_ROUTELOC0_CC0LOC_LOC29
 
 	#define ENC2_PIN            (6)
 	#define ENC2_PORT           (gpioPortF)
-	#define ENC2_TIM1_CC1       TIMER_ROUTELOC0_CC1LOC_LOC29
 
 	#define ENCP_PIN            (7)
 	#define ENCP_PORT           (gpioPortF)
@@ -127,6 +122,10 @@ extern void PORTIO_enter_DefaultMode_from_RESET(void);
 #define TEST_PIN          (11)
 #define TEST_PORT         (gpioPortB)
 
+// PRS channels carrying encoder signals to PCNT0
+#define ENC1_PRS_CH       pcntPRSCh6
+#define ENC2_PRS_CH       pcntPRSCh7
+
 // [User-defined pin name abstraction]$
 
 #endif
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_BOOTPROF_H_
+#define INC_BOOTPROF_H_
+
+/* Startup time profiler.
+ * Milestones during boot are timestamped using the cycle counter
+ * and printed once all of them have been reached. */
+
+enum boot_milestone {
+	BOOT_CHIP_INIT,
+	BOOT_CLOCKS,
+	BOOT_SCHEDULER,
+	BOOT_RAIL_INIT,
+	BOOT_DISPLAY_READY,
+	BOOT_FIRST_RX_BLOCK,
+	BOOT_FIRST_AUDIO,
+	BOOT_MILESTONES
+};
+
+/* Start the cycle counter. Call first thing in main. */
+void boot_profile_start(void);
+
+/* Record the time a milestone was first reached.
+ * Can be called from any context, also interrupts. */
+void boot_milestone(enum boot_milestone m);
+
+/* Print the milestones once they have all been reached.
+ * Called regularly from a task. */
+void boot_profile_report(void);
+
+#endif /* INC_BOOTPROF_H_ */
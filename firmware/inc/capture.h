@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_CAPTURE_H_
+#define INC_CAPTURE_H_
+
+#include <stdint.h>
+#include "dsp.h"
+
+/* Signal capture.
+ *
+ * When built with CAPTURE=1, the signal at one point of the DSP
+ * chain can be streamed to RTT up-buffer 2. Select the point
+ * and the codec by writing capture.tap and capture.codec
+ * from a debugger. tools/capture_decode turns the stream
+ * into WAV files and raw I/Q for the host DSP tests.
+ *
+ * Every DSP block is sent as a header followed by the samples.
+ * Blocks are written whole or not at all. A block which does not
+ * fit in the buffer is dropped, and the gap in sequence numbers
+ * tells the host how many were lost.
+ *
+ * Raw I/Q at 48 kHz needs about 200 kB/s, which is more than
+ * most SWD adapters can read, so the 8-bit codecs are
+ * the default. Audio taps fit the link with any codec.
+ */
+
+enum capture_tap {
+	CAPTURE_OFF,
+	CAPTURE_RX_IQ,     // Received I/Q from RAIL, 48 kHz
+	CAPTURE_RX_MIXED,  // I/Q after the mixer, FM and AM only, 48 kHz
+	CAPTURE_RX_DEMOD,  // Demodulated audio before filtering, 24 kHz
+	CAPTURE_RX_AUDIO,  // Audio output, minus AUDIO_MID, 24 kHz
+	CAPTURE_TX_MIC,    // Microphone from the ADC, minus mid-scale, 24 kHz
+	CAPTURE_TAPS
+};
+
+enum capture_codec {
+	CAPTURE_RAW16,     // 16-bit little endian samples
+	CAPTURE_BFP8,      // 8-bit mantissas sharing the block exponent
+	CAPTURE_MULAW,     // 8-bit G.711 mu-law
+	CAPTURE_CODECS
+};
+
+#define CAPTURE_MAGIC 0xC5
+// Largest number of values in a block
+#define CAPTURE_MAXLEN 128
+
+/* Header of a captured block, followed by the samples.
+ * A sample decodes to a 16-bit value which is multiplied by
+ * 2^exponent. I/Q taps send I and Q of each sample in turn,
+ * and n counts both. */
+struct capture_header {
+	uint8_t magic;
+	// enum capture_tap
+	uint8_t tap;
+	// enum capture_codec
+	uint8_t codec;
+	int8_t exponent;
+	// Incremented for every block, including those dropped
+	uint16_t seq;
+	// Number of values
+	uint16_t n;
+	// DWT cycle counter at the end of the block
+	uint32_t cycles;
+};
+
+// Sample rate of each tap
+#define CAPTURE_TAP_FS(tap) \
+	((tap) == CAPTURE_RX_IQ || (tap) == CAPTURE_RX_MIXED ? RX_IQ_FS : TX_FS)
+#define CAPTURE_TAP_IS_IQ(tap) \
+	((tap) == CAPTURE_RX_IQ || (tap) == CAPTURE_RX_MIXED)
+
+#if CAPTURE
+struct capture {
+	volatile uint8_t tap, codec;
+};
+extern struct capture capture;
+
+void capture_iq_in(const iq_in_t *in, unsigned len);
+void capture_iq_float(const iq_float_t *in, unsigned len);
+void capture_float(enum capture_tap tap, const float *in, unsigned len);
+void capture_u16(enum capture_tap tap, const uint16_t *in, unsigned len, uint16_t mid);
+
+/* Capture a block if tap is selected.
+ * The check is inline, so an unused tap costs one comparison. */
+#define CAPTURE_TAP(t, call) do { \
+		if (capture.tap == (t)) \
+			call; \
+	} while (0)
+#else
+#define CAPTURE_TAP(t, call) do {} while (0)
+#endif
+
+#endif /* INC_CAPTURE_H_ */
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_DEBUGPRINT_H_
+#define INC_DEBUGPRINT_H_
+
+/* RTT up channels (MCU to debugger).
+ * Channel numbers stay the same in every build, so host tools
+ * can rely on them. A channel disabled at build time has
+ * no buffer and writes to it are dropped. */
+enum rtt_channel {
+	RTT_PRINT,   // printf text
+	RTT_TRACE,   // Binary trace records, see trace.h
+	RTT_CAPTURE, // Captured signal blocks, see capture.h
+	RTT_RECORD,  // Recorded DSP inputs, see record.h
+	RTT_CHANNELS
+};
+
+void debug_init(void);
+
+/* Write to an RTT channel without blocking.
+ * Data is written whole or not at all, so a reader never sees
+ * partial records. If there is no space, the bytes are counted
+ * in diag.rtt_dropped.
+ * Can be called from tasks and interrupts.
+ * Returns 1 if written, 0 if dropped. */
+int rtt_write(enum rtt_channel ch, const void *data, unsigned len);
+
+/* Returns the number of bytes which can be written to a channel.
+ * With a single writer, the space only grows until it writes. */
+unsigned rtt_space(enum rtt_channel ch);
+
+#endif /* INC_DEBUGPRINT_H_ */
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_DIAGNOSTICS_H_
+#define INC_DIAGNOSTICS_H_
+
+#include <stdint.h>
+#include "em_device.h"
+#include "debugprint.h"
+
+/* Diagnostics counters.
+ * These can be read using a debugger. */
+struct diagnostics {
+	uint32_t rx_blocks_overflow, rx_blocks_isr, rx_blocks_task;
+	uint32_t rx_rail_underruns, rx_samples_isr;
+	uint32_t tx_blocks_overflow, tx_blocks_isr, tx_blocks_task;
+	// Most blocks waiting in the fast DSP queues
+	uint32_t rx_queue_max, tx_queue_max;
+	// Received blocks processed with only the squelch measurement
+	uint32_t rx_blocks_quiet;
+
+	// Cycle counters to estimate CPU usage of fast DSP
+	uint32_t cycles_dsp, cycles_nodsp;
+
+	// Estimate of CPU time used by fast DSP
+	float dsp_cpu_use;
+
+	// Text renderer glyph cache
+	uint32_t glyph_cache_hits, glyph_cache_misses;
+
+	// Waterfall lines drawn, and dropped because
+	// the display task was behind
+	uint32_t waterfall_lines_drawn, waterfall_lines_dropped;
+
+	// Waterfall FFTs skipped while the display is idle
+	uint32_t waterfall_ffts_skipped;
+
+	// Cycles spent on waterfall calculation and estimated CPU usage
+	uint32_t cycles_waterfall;
+	float waterfall_cpu_use;
+
+	// Number of retunes using the fast path and full configuration
+	uint32_t retunes_fast, retunes_full;
+	// Latest and maximum time from start of a retune
+	// to the radio running again, in microseconds
+	uint32_t retune_us, retune_us_max;
+
+	// Scan rate and the time from start of a scan step
+	// to squelch measurement being ready, in microseconds
+	uint32_t scan_channels_per_s, scan_settle_us;
+
+	// Time of a band scope sweep in milliseconds
+	uint32_t scope_sweep_ms;
+
+	// Latest time from a PTT press to transmission starting
+	// and from a PTT release to the first received audio block,
+	// in microseconds
+	uint32_t ptt_tx_us, unkey_rx_us;
+
+	// Image rejection calibrations calculated and loaded from flash,
+	// and temperature calibrations
+	uint32_t cal_ir_runs, cal_ir_cached, cal_temp_runs;
+
+	// Time from the start of main at boot
+	// to the first received audio block, in milliseconds
+	uint32_t startup_audio_ms;
+
+	// Tickless idle sleeps ending in a wakeup, ticks spent in them,
+	// and sleeps abandoned because a task became ready.
+	// All sleeps are in EM1, see idle_sleep in main.c.
+	uint32_t sleep_tickless, sleep_ticks, sleep_aborted;
+	// Waits for an interrupt in idle times too short for tickless idle
+	uint32_t sleep_wfi;
+
+	// Trace records dropped because the RTT buffer was full
+	uint32_t trace_dropped;
+
+	// Captured signal blocks dropped because the RTT buffer was full
+	uint32_t capture_dropped;
+
+	// Ticks the DSP recorder waited for the debugger to read
+	uint32_t record_waits;
+
+	// Bytes dropped on each RTT channel because its buffer was full
+	uint32_t rtt_dropped[RTT_CHANNELS];
+
+	// Cycles spent in interrupt handlers, see diag_isr_enter
+	uint32_t cycles_isr;
+	uint32_t isr_depth, isr_start;
+};
+extern struct diagnostics diag;
+
+/* Count time spent in an interrupt handler into diag.cycles_isr.
+ * Call diag_isr_enter at the start of the handler and
+ * diag_isr_exit before every return. Only the outermost
+ * handler is counted, so nested ones are not counted twice. */
+static inline void diag_isr_enter(void)
+{
+	if (diag.isr_depth++ == 0)
+		diag.isr_start = DWT->CYCCNT;
+}
+
+static inline void diag_isr_exit(void)
+{
+	if (--diag.isr_depth == 0)
+		diag.cycles_isr += DWT->CYCCNT - diag.isr_start;
+}
+
+#endif /* INC_DIAGNOSTICS_H_ */
@@ -5,14 +5,16 @@
 
 #include <stdint.h>
 
+// Number and size of render buffers
+#define DISPLAY_RENDER_BUFS 2
+#define DISPLAY_BUF_SIZE (3*8*8*8)
+
 int display_init(void);
 int display_ready(void);
 
-void display_area(int x1,int y1,int x2,int y2);
-void display_start(void);
-void display_end(void);
-void display_pixel(uint8_t r, uint8_t g, uint8_t b);
-void display_transfer(const uint8_t *dmadata, int dmalen);
+uint8_t *display_buffer(void);
+void display_window(int x1, int y1, int x2, int y2, const uint8_t *data, int len);
+void display_sync(void);
 void display_scroll(unsigned y);
 void display_backlight(int b);
 
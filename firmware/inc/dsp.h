@@ -33,8 +33,55 @@ typedef struct {
 // TX sample rate
 #define TX_FS 24000
 
+/* Parameters used by the fast DSP, calculated from
+ * rig parameters by dsp_update_params */
+struct dsp_params {
+	// Receive oscillator frequencies as rotations per sample
+	float bfofreq_i, bfofreq_q, ddcfreq_i, ddcfreq_q, mixfreq_i, mixfreq_q;
+	// Transmit oscillator frequencies
+	float tx_bfofreq_i, tx_bfofreq_q, ctfreq_i, ctfreq_q;
+	float audiogain, squelch;
+	// Signal power at the squelch level in modes other than FM
+	float squelch_power;
+	// enum rig_mode
+	uint8_t mode;
+	// 1 if fine tuning mixer is used
+	uint8_t mix_on;
+};
+
 int dsp_fast_rx(iq_in_t *in, int in_len, audio_out_t *out, int out_len);
 int dsp_fast_tx(audio_in_t *in, fm_out_t *out, int len);
 void dsp_update_params(void);
+/* Set the parameters used from the start of the next block.
+ * dsp_update_params calls this, and a replay of a recording
+ * calls it directly with the recorded parameters. */
+void dsp_set_params(const struct dsp_params *params);
+
+/* Restart squelch measurement after retuning.
+ * The RAIL task semaphore is given when it has settled. */
+void dsp_squelch_restart(void);
+// Returns 1 once squelch measurement has settled after restart
+int dsp_squelch_settled(void);
+/* Returns 1 if there is a signal to stop scanning on.
+ * FM uses the same criterion as audio output. Other modes compare
+ * the signal power to the squelch level, but do not mute audio. */
+int dsp_signal_present(void);
+/* Returns 1 while squelch is closed.
+ * Audio output is then silent and the PWM does not need updating. */
+int dsp_audio_parked(void);
+
+// Number of synthesizer steps in a band scope sweep.
+// Each step gives 2 pixels.
+#define SCOPE_STEPS 64
+
+/* Capture band scope data for a sweep step.
+ * Called after tuning to the step.
+ * The RAIL task semaphore is given when done. */
+void dsp_scope_capture(unsigned step);
+/* Skip a band scope step that cannot be tuned to.
+ * The RAIL task semaphore is given when done. */
+void dsp_scope_skip(unsigned step);
+// Returns 1 when the latest capture has been processed
+int dsp_scope_done(void);
 
 #endif
@@ -9,5 +9,8 @@ void dsp_rtos_init(void);
 void fast_dsp_task(void *);
 int start_rx_dsp(RAIL_Handle_t rail);
 int start_tx_dsp(RAIL_Handle_t rail);
+/* Measure the time from cycle counter value start_cycles
+ * to the first audio block produced after receive is started. */
+void dsp_measure_rx_latency(uint32_t start_cycles);
 
 #endif
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_FREQPLAN_H_
+#define INC_FREQPLAN_H_
+
+#include <stdint.h>
+
+/* Frequency plan.
+ * The VCO divider only depends on which range the frequency
+ * falls into, so the ranges are precomputed into a table
+ * by tools/freqplan_gen. */
+
+// Frequencies in the table are shifted right by this
+#define FREQPLAN_SHIFT 10
+
+struct freqplan_range {
+	// First frequency of the range, shifted right by FREQPLAN_SHIFT
+	uint32_t start;
+	// SYNTH_DIVCTRL register value, 0 if the range cannot be tuned
+	uint16_t divider;
+	// Total division ratio
+	uint8_t ratio;
+	// 1 if the 2.4 GHz power amplifier is used
+	uint8_t pa_2g4;
+};
+
+// Table sorted by start, first entry starting from 0
+extern const struct freqplan_range freqplan_table[];
+extern const unsigned freqplan_table_len;
+
+/* Find the range a frequency belongs to. */
+const struct freqplan_range *freqplan_lookup(uint32_t freq);
+
+/* Returns 1 if a frequency can be tuned to. */
+static inline int freqplan_tunable(uint32_t freq)
+{
+	return freqplan_lookup(freq)->divider != 0;
+}
+
+#endif /* INC_FREQPLAN_H_ */
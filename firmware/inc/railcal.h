@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_RAILCAL_H_
+#define INC_RAILCAL_H_
+
+#include "rail.h"
+
+/* Radio calibration cache.
+ * Image rejection calibration values are stored in a flash page
+ * for each VCO divider, so they only have to be calculated once.
+ * A value is calculated again if the temperature has changed too
+ * much since it was stored, or if the radio configuration or
+ * RAIL library has changed. */
+
+/* Prepare the cache. Call before the radio is configured. */
+void railcal_init(void);
+
+/* Apply the calibration for a divider after a full configuration.
+ * Radio has to be idle. */
+void railcal_apply(RAIL_Handle_t rail, uint32_t divider);
+
+/* Run any calibrations RAIL has asked for. */
+void railcal_pending(RAIL_Handle_t rail, uint32_t divider);
+
+#endif /* INC_RAILCAL_H_ */
@@ -9,6 +9,14 @@
 void railtask_main(void *);
 void railtask_rtos_init(void);
 
+// Returns 1 if the radio can be tuned to a frequency.
+int railtask_tunable(uint32_t freq);
+
+/* Wake up RAIL task after p.keyed has changed.
+ * cycles is the cycle counter value at the time of the
+ * key or unkey event, used to measure latency. */
+void railtask_key_changed(uint32_t cycles);
+
 // Semaphore used to wake up RAIL task when it needs to do something.
 extern xSemaphoreHandle railtask_sem;
 
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_RECORD_H_
+#define INC_RECORD_H_
+
+#include <stdint.h>
+#include "dsp.h"
+
+/* Recording of fast DSP inputs.
+ *
+ * When built with RECORD=1, every block given to dsp_fast_rx and
+ * dsp_fast_tx is written to RTT up-buffer 3 together with the
+ * parameter changes applied before it. test/dsp_replay feeds
+ * the recording through dsp.c on the host, checks that the output
+ * of every block is the same as on the device and shows how many
+ * cycles each block took.
+ *
+ * A replay is only exact if nothing is lost, so the recorder
+ * waits for the debugger to make space instead of dropping
+ * records. The DSP then falls behind if the link is slow,
+ * and the driver drops whole blocks, which never reach dsp.c
+ * and do not break the replay. Recording starts at boot,
+ * so the replay starts from the same state as the device.
+ *
+ * Multiply-adds are not fused in RECORD=1 builds or in the
+ * replay, so that floating point results round the same way
+ * on both.
+ */
+
+#define RECORD_MAGIC 0xD5
+// Incremented when the format of records or struct dsp_params changes
+#define RECORD_VERSION 2
+
+struct record_header {
+	uint8_t magic;
+	// enum record_type
+	uint8_t type;
+	// Bytes after the header
+	uint16_t len;
+	// DWT cycle counter
+	uint32_t cycles;
+};
+
+enum record_type {
+	RECORD_START,            // struct record_start
+	RECORD_PARAMS,           // struct dsp_params
+	RECORD_SQUELCH_RESTART,  // No data
+	RECORD_RX,               // struct record_block and iq_in_t samples
+	RECORD_TX,               // struct record_block and audio_in_t samples
+};
+
+struct record_start {
+	uint16_t version;
+	uint16_t params_size;
+};
+
+/* Block given to dsp_fast_rx or dsp_fast_tx.
+ * The header has the cycle counter at the start of the block. */
+struct record_block {
+	// record_hash of the output
+	uint32_t out_hash;
+	// Cycles taken by the block
+	uint32_t cycles;
+	// Number of input and output samples
+	uint16_t in_len, out_len;
+};
+
+// FNV-1a hash, used to compare outputs
+static inline uint32_t record_hash(const void *data, unsigned len)
+{
+	const uint8_t *d = data;
+	uint32_t h = 2166136261u;
+	unsigned i;
+	for (i = 0; i < len; i++)
+		h = (h ^ d[i]) * 16777619u;
+	return h;
+}
+
+#if RECORD
+void record_params(const struct dsp_params *params);
+void record_squelch_restart(void);
+void record_begin(void);
+void record_rx(const iq_in_t *in, unsigned in_len, const audio_out_t *out, unsigned out_len);
+void record_tx(const audio_in_t *in, const fm_out_t *out, unsigned len);
+
+#define RECORD_HOOK(call) call
+#else
+#define RECORD_HOOK(call) do {} while (0)
+#endif
+
+#endif /* INC_RECORD_H_ */
@@ -21,6 +21,16 @@ enum rig_mode {
 	MODE_OFF
 };
 
+enum rig_scan {
+	SCAN_OFF,
+	// Scan a range of channels
+	SCAN_RANGE,
+	// Sweep a range to show a wideband spectrum
+	SCAN_SCOPE,
+	// Scan frequencies of memory channels
+	SCAN_MEM,
+};
+
 // parameters communicated from UI to RAIL and DSP parts
 typedef struct {
 	//int channel;
@@ -36,12 +46,19 @@ typedef struct {
 	unsigned squelch;
 	// CTCSS frequency in Hz, 0.0f for no CTCSS
 	float ctcss;
+	// Scanner mode, channel step and width of scanned range
+	enum rig_scan scan;
+	uint32_t scan_step, scan_span;
 } rig_parameters_t;
 extern rig_parameters_t p;
 
 // status communicated from DSP to UI
 typedef struct {
 	uint32_t smeter;
+	// Difference of the wanted receive frequency from the
+	// synthesizer frequency, tuned digitally by DSP.
+	// Set by the RAIL task.
+	int32_t rx_finetune;
 } rig_status_t;
 extern rig_status_t rs;
 #define FFTLEN 256
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_SCAN_H_
+#define INC_SCAN_H_
+
+#include "FreeRTOS.h"
+
+/* Channel scanner.
+ * These are called from the RAIL task. */
+
+// Called before tuning. May change p.frequency.
+void scan_update(void);
+
+/* In band scope mode, replace the frequency to tune to
+ * by the frequency of the current sweep step and return 1.
+ * Otherwise return 0. */
+int scan_tune(uint32_t *frequency);
+
+// Called after the radio has been tuned and started.
+void scan_tuned(void);
+
+// Returns how long the RAIL task may wait for its semaphore.
+TickType_t scan_wait_time(void);
+
+#endif /* INC_SCAN_H_ */
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_SETTINGS_H_
+#define INC_SETTINGS_H_
+
+#include <stdint.h>
+
+/* Settings store.
+ * Settings are 32-bit values identified by a key. They are kept
+ * in a RAM table and written as a log of records into the last two
+ * flash pages. Changes are written by a low priority task after
+ * they have stayed the same for a while. */
+
+// Number of memory channels
+#define SETTINGS_CHANNELS 16
+
+enum setting_key {
+	// Selected memory channel
+	SETTING_CHANNEL,
+	SETTING_VOLUME,
+	SETTING_WATERFALL,
+	SETTING_SQUELCH,
+	// Indexes to scan step and span choices
+	SETTING_SCAN_STEP,
+	SETTING_SCAN_SPAN,
+	SETTINGS_GLOBAL
+};
+
+// Settings stored for each memory channel
+enum setting_channel_key {
+	SETTING_CH_FREQUENCY,
+	SETTING_CH_MODE,
+	SETTING_CH_SPLIT,
+	SETTING_CH_OFFSET,
+	// Index to CTCSS frequencies
+	SETTING_CH_CTCSS,
+	SETTINGS_PER_CHANNEL
+};
+
+// Key of a memory channel setting
+#define SETTING_CH(ch, k) (SETTINGS_GLOBAL + (ch) * SETTINGS_PER_CHANNEL + (k))
+
+#define SETTINGS_N SETTING_CH(SETTINGS_CHANNELS, 0)
+
+/* Read settings from flash into the RAM table.
+ * Called at boot before starting the scheduler. */
+void settings_init(void);
+
+/* Get a setting. Returns 1 if the setting has been stored. */
+int settings_get(unsigned key, uint32_t *value);
+
+/* Change a setting. It is written to flash later. */
+void settings_set(unsigned key, uint32_t value);
+
+/* Write changed settings to flash immediately.
+ * Called before turning off. */
+void settings_flush(void);
+
+/* Task writing changed settings to flash. */
+void settings_task(void *);
+
+#endif /* INC_SETTINGS_H_ */
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include <stdint.h>
+
+/* Binary RTOS trace.
+ *
+ * When built with TRACE=1, task switches, interrupts, queue sends
+ * and semaphore gives are written as trace records to RTT
+ * up-buffer 1. tools/trace2json converts them to the Chrome
+ * trace event format, which can be viewed in chrome://tracing
+ * or https://ui.perfetto.dev/.
+ *
+ * Records are written whole or not at all. If the buffer is full,
+ * records are dropped and a TRACE_DROPPED record tells
+ * how many were lost once there is space again.
+ */
+
+/* Trace record.
+ * TRACE_TASK_NAME records are followed by arg bytes of name,
+ * padded to a multiple of the record size. */
+struct trace_record {
+	// DWT cycle counter
+	uint32_t cycles;
+	// enum trace_type
+	uint8_t type;
+	// Task, queue or interrupt number
+	uint8_t id;
+	uint16_t arg;
+};
+
+enum trace_type {
+	TRACE_TASK_NAME,       // arg = name length
+	TRACE_TASK_SWITCH,     // id = task switched in
+	TRACE_ISR_ENTER,       // id = enum trace_isr
+	TRACE_ISR_EXIT,        // id = enum trace_isr
+	TRACE_QUEUE_CREATE,    // arg = queue type in FreeRTOS
+	TRACE_QUEUE_SEND,      // Also semaphore give, arg = queue type
+	TRACE_QUEUE_SEND_FAILED,
+	TRACE_NOTIFY,          // id = task notified
+	TRACE_DROPPED,         // arg = number of records dropped
+};
+
+enum trace_isr {
+	TRACE_ISR_RAIL,
+	TRACE_ISR_SAMPLE_TIMER,
+	TRACE_ISR_DISPLAY_DMA,
+	TRACE_ISR_UI_GPIO,
+};
+
+#if TRACE
+/* The RAIL callback and the sample rate timer run on every audio
+ * sample, which would fill the link many times over, so they are not
+ * traced by default. Queue sends from them are still traced.
+ * Set bits in trace_isrs from a debugger to trace them too. */
+#define TRACE_ISRS_DEFAULT \
+	((1 << TRACE_ISR_DISPLAY_DMA) | (1 << TRACE_ISR_UI_GPIO))
+extern volatile uint32_t trace_isrs;
+
+void trace_event(uint8_t type, uint8_t id, uint16_t arg);
+void trace_name(uint8_t type, uint8_t id, uint16_t arg, const char *name);
+unsigned trace_queue_create(uint8_t queue_type);
+
+#define TRACE_ISR_ENTER(isr) do { \
+		if (trace_isrs & (1 << (isr))) \
+			trace_event(TRACE_ISR_ENTER, (isr), 0); \
+	} while (0)
+#define TRACE_ISR_EXIT(isr) do { \
+		if (trace_isrs & (1 << (isr))) \
+			trace_event(TRACE_ISR_EXIT, (isr), 0); \
+	} while (0)
+#else
+#define TRACE_ISR_ENTER(isr) do {} while (0)
+#define TRACE_ISR_EXIT(isr) do {} while (0)
+#endif
+
+#endif /* INC_TRACE_H_ */
@@ -4,17 +4,29 @@
 #define INC_UI_H_
 
 /* Before including this, include at least
- * FreeRTOS.h and semphr.h */
+ * FreeRTOS.h and semphr.h, and ui_parameters.h
+ * to use WATERFALL_LINE_BYTES. */
 
 void ui_check_buttons(void);
 void ui_control_backlight(void);
 
+/* Returns 1 if the backlight has been dimmed
+ * because the user has not done anything for a while.
+ * Never idle while the diagnostics view is shown. */
+int ui_is_idle(void);
+
 void display_task(void *arg);
 void ui_rtos_init(void);
 
+/* Copy global parameters into settings.
+ * Memory channels are only stored when their parameters are edited. */
+void ui_settings_capture(void);
+
+/* Set parameters from stored settings. Called at boot. */
+void ui_settings_restore(void);
+
 struct display_ev {
 	char text_changed;
-	char waterfall_line;
 };
 
 /* Display event flags. Tells the display driver
@@ -26,4 +38,19 @@ extern volatile struct display_ev display_ev;
  * Given after setting a display event flag. */
 extern SemaphoreHandle_t display_sem;
 
+/* Ring of waterfall lines waiting to be drawn.
+ * Lines are written by the slow DSP task and drawn
+ * in batches by the display task. */
+#define WATERFALL_RING_LEN 4
+#define WATERFALL_LINE_BYTES (3*(FFT_BIN2-FFT_BIN1))
+
+/* Get a free line in the waterfall ring to write to.
+ * Returns NULL if the ring is full, in which case
+ * the line is dropped and counted in diagnostics. */
+uint8_t *ui_waterfall_line_begin(void);
+
+/* Pass the line written by the previous
+ * ui_waterfall_line_begin call to the display task. */
+void ui_waterfall_line_done(void);
+
 #endif /* INC_UI_H_ */
@@ -8,12 +8,12 @@
 #ifndef INC_UI_HW_H_
 #define INC_UI_HW_H_
 
-#include "em_timer.h"
+#include "em_pcnt.h"
 #include "em_gpio.h"
 #include "InitDevice.h"
 
 static inline unsigned get_encoder_position() {
-	return TIMER_CounterGet(TIMER1);
+	return PCNT_CounterGet(PCNT0);
 }
 static inline unsigned get_encoder_button() {
 	return GPIO_PinInGet(ENCP_PORT, ENCP_PIN) == 0;
@@ -22,4 +22,11 @@ static inline unsigned get_ptt() {
 	return GPIO_PinInGet(PTT_PORT, PTT_PIN) == 0;
 }
 
+/* Enable input interrupts. Encoder, encoder button and PTT
+ * edges wake up the calling task using task notifications. */
+void ui_hw_init(void);
+
+// Cycle counter value at the latest PTT edge
+extern volatile uint32_t ptt_edge_cycles;
+
 #endif /* INC_UI_HW_H_ */
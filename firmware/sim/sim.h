@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The simulation advances one sample of the 24 kHz sample timer at a
+ * time. Everything driven by hardware happens on these steps: the RAIL
+ * receive FIFO event, the sample timer interrupt, the RTOS tick and
+ * the end of display DMA transfers. The cycle counter is set from the
+ * step count, so it only moves in steps of 1600 cycles. */
+#define SIM_FS 24000
+#define SIM_CYCLES_PER_SAMPLE (38400000 / SIM_FS)
+#define SIM_SAMPLES_PER_TICK (SIM_FS / 1000)
+
+// Display SPI clock
+#define SIM_SPI_HZ 16000000
+
+/* Simulated interrupts, in order of priority.
+ * Numbers are the ones used by the FreeRTOS POSIX port. */
+enum sim_irq {
+	SIM_IRQ_RAIL,
+	SIM_IRQ_TIMER1,
+	SIM_IRQ_LDMA,
+	SIM_IRQ_GPIO_EVEN,
+	SIM_IRQ_GPIO_ODD,
+	// Stop the simulation and print the report
+	SIM_IRQ_HALT,
+	SIM_IRQS
+};
+
+struct sim_options {
+	// Input files, NULL for silence
+	const char *iq_in, *mic_in, *events;
+	// Output files, NULL if not written
+	const char *audio_out, *fm_out, *rail_log;
+	// Prefix of display frame images and file of display frame counts
+	const char *display_frames, *display_stats;
+	// File backing the settings flash pages, NULL for erased flash
+	const char *flash;
+	// Simulated time per wall clock time
+	double speed;
+	// Simulated seconds to run, 0 to run until quit
+	double seconds;
+	// Display frame period in milliseconds
+	unsigned frame_ms;
+};
+extern struct sim_options sim_opt;
+
+struct sim_stats {
+	// Interrupts raised and raised again before handled
+	uint32_t irqs[SIM_IRQS], overruns[SIM_IRQS];
+	// Steps which started later than one sample from their time
+	uint64_t late_samples;
+	// Wall clock time at the start in nanoseconds
+	uint64_t start_ns;
+};
+extern struct sim_stats sim_stats;
+
+// Write to a register which is read-only for software
+#define SIM_REG(reg) (*(volatile uint32_t *)&(reg))
+
+// Number of the current step
+extern volatile uint64_t sim_samples;
+
+static inline double sim_seconds(void)
+{
+	return (double)sim_samples / SIM_FS;
+}
+
+/* Timing of the simulated radio, see sim_rail.c */
+struct sim_rail_model {
+	// Received IQ samples per second
+	unsigned rx_rate;
+	// Time RAIL calls keep the calling task busy in microseconds
+	unsigned config_channels_us, freq_offset_us, idle_us;
+	// Time from starting the radio to receiving or transmitting
+	unsigned rx_warmup_us, tx_warmup_us;
+};
+extern struct sim_rail_model sim_rail_model;
+
+/* sim_main.c */
+uint64_t sim_wall_ns(void);
+void sim_report(void);
+FILE *sim_open(const char *name, const char *mode);
+
+/* sim_clock.c */
+void sim_clock_start(void);
+void sim_raise(enum sim_irq irq);
+
+/* sim_periph.c */
+void sim_periph_init(void);
+void sim_periph_step(void);
+void sim_gpio_input(unsigned port, unsigned pin, int level);
+void sim_periph_report(void);
+
+/* sim_rail.c */
+void sim_rail_init(void);
+void sim_rail_step(void);
+int sim_rail_receiving(void);
+void sim_rail_ptt(int keyed);
+void sim_rail_report(void);
+
+/* sim_display.c */
+void sim_display_init(void);
+void sim_display_byte(int dc, uint8_t b);
+void sim_display_step(void);
+void sim_display_report(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Simulation clock.
+ *
+ * A thread outside FreeRTOS steps the simulation at the sample
+ * rate, scaled by the speed option, and raises the interrupts which
+ * the hardware would raise. Input events from the events file are
+ * applied at their simulated time. */
+
+#include "em_device.h"
+
+#include "FreeRTOS.h"
+
+// rig
+#include "InitDevice.h"
+#include "ui_hw.h"
+
+#include "sim.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+
+// Longest wait for raised interrupts to be handled
+#define SIM_IRQ_WAIT_NS 2000000
+
+// Encoder counts per knob step, ENCODER_DIVIDER in ui.c
+#define SIM_ENCODER_COUNTS 4
+
+volatile uint64_t sim_samples;
+struct sim_stats sim_stats;
+
+struct sim_event {
+	uint64_t sample;
+	char name[16];
+	int value;
+};
+
+static struct {
+	struct sim_event *events;
+	unsigned n_events, next_event;
+} sim_clock;
+
+
+void sim_raise(enum sim_irq irq)
+{
+	sim_stats.irqs[irq]++;
+	if (!xPortGenerateSimulatedInterrupt(irq))
+		sim_stats.overruns[irq]++;
+}
+
+
+/* Events file has a line for each event:
+ * <time in milliseconds> <event> [value]
+ * Lines starting with # are comments. */
+static void events_load(const char *name)
+{
+	FILE *f = sim_open(name, "r");
+	char line[128];
+	unsigned lineno = 0, size = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		double ms;
+		struct sim_event e = { .value = 1 };
+		lineno++;
+		if (line[strspn(line, " \t")] == '#')
+			continue;
+		int n = sscanf(line, "%lf %15s %d", &ms, e.name, &e.value);
+		if (n <= 0)
+			continue;
+		if (n < 2) {
+			fprintf(stderr, "%s:%u: event missing\n", name, lineno);
+			exit(2);
+		}
+		e.sample = (uint64_t)(ms * SIM_FS / 1000);
+		if (sim_clock.n_events >= size) {
+			size = size ? size * 2 : 16;
+			sim_clock.events = realloc(sim_clock.events, size * sizeof(e));
+		}
+		sim_clock.events[sim_clock.n_events++] = e;
+	}
+	fclose(f);
+}
+
+
+static void event_apply(const struct sim_event *e)
+{
+	if (strcmp(e->name, "ptt") == 0) {
+		sim_rail_ptt(e->value);
+		sim_gpio_input(PTT_PORT, PTT_PIN, !e->value);
+	} else if (strcmp(e->name, "button") == 0) {
+		sim_gpio_input(ENCP_PORT, ENCP_PIN, !e->value);
+	} else if (strcmp(e->name, "knob") == 0) {
+		// Encoder is counted by PCNT0 and its pins only wake up the UI
+		SIM_REG(PCNT0->CNT) = (PCNT0->CNT + e->value * SIM_ENCODER_COUNTS) & 0xFFFF;
+		sim_gpio_input(ENC1_PORT, ENC1_PIN, -1);
+	} else if (strcmp(e->name, "quit") == 0) {
+		sim_raise(SIM_IRQ_HALT);
+	} else {
+		fprintf(stderr, "Unknown event %s\n", e->name);
+	}
+}
+
+
+static void sim_step(void)
+{
+	uint64_t n = ++sim_samples;
+	DWT->CYCCNT = (uint32_t)(n * SIM_CYCLES_PER_SAMPLE);
+
+	while (sim_clock.next_event < sim_clock.n_events
+		&& sim_clock.events[sim_clock.next_event].sample <= n)
+		event_apply(&sim_clock.events[sim_clock.next_event++]);
+
+	sim_periph_step();
+	sim_rail_step();
+	sim_display_step();
+
+	if (n % SIM_SAMPLES_PER_TICK == 0 && xPortSchedulerRunning())
+		xPortGenerateSimulatedInterrupt(portINTERRUPT_TICK);
+}
+
+
+static void *sim_clock_thread(void *arg)
+{
+	(void)arg;
+	struct timespec t;
+	uint64_t start = sim_wall_ns(), halt_ns = 0;
+	uint64_t end = (uint64_t)(sim_opt.seconds * SIM_FS);
+	double step_ns = 1e9 / (SIM_FS * sim_opt.speed);
+	// Sleeping ends late by the timer slack, 50 us by default
+	prctl(PR_SET_TIMERSLACK, 1UL);
+
+	for (;;) {
+		uint64_t n = sim_samples;
+		uint64_t target = start + (uint64_t)((n + 1) * step_ns);
+		uint64_t now = sim_wall_ns();
+		if (now < target) {
+			t.tv_sec = target / 1000000000;
+			t.tv_nsec = target % 1000000000;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+		} else if (now > target + step_ns) {
+			/* Steps are not run faster to catch up, since tasks
+			 * would then get less time per step than they should.
+			 * The simulation continues from here, slower. */
+			sim_stats.late_samples++;
+			start += now - target;
+		}
+		/* Threads of the host do not run at once when signalled,
+		 * so give the interrupts raised on the previous step some
+		 * time to be handled. This keeps host scheduling delays from
+		 * showing up as overruns. Interrupts left pending longer
+		 * are masked by the firmware and count as overruns. */
+		uint64_t wait_end = sim_wall_ns() + SIM_IRQ_WAIT_NS;
+		while (xPortInterruptsPending() && sim_wall_ns() < wait_end)
+			sched_yield();
+
+		if (halt_ns) {
+			// Interrupts are masked for too long, so report without tasks
+			if (sim_wall_ns() - halt_ns > 2000000000) {
+				fprintf(stderr, "Halt interrupt not handled\n");
+				sim_report();
+				_exit(1);
+			}
+			usleep(1000);
+			continue;
+		}
+		sim_step();
+		if (end && sim_samples >= end) {
+			sim_raise(SIM_IRQ_HALT);
+			halt_ns = sim_wall_ns();
+		}
+	}
+	return NULL;
+}
+
+
+void sim_clock_start(void)
+{
+	pthread_t thread;
+	sigset_t set, old;
+	if (sim_opt.events != NULL)
+		events_load(sim_opt.events);
+	sim_stats.start_ns = sim_wall_ns();
+
+	// The clock thread should not receive the interrupt signals
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	if (pthread_create(&thread, NULL, sim_clock_thread, NULL) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+	pthread_setname_np(thread, "sim clock");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
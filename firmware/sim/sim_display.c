@@ -0,0 +1,333 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Simulated ST7735 display.
+ *
+ * Bytes sent to the display on USART1 are interpreted with the
+ * commands display.c uses: column and row address set, memory write
+ * and vertical scrolling. Pixels go to the display memory in the
+ * default 18-bit format, three bytes per pixel.
+ *
+ * The screen is composed from the memory through the vertical
+ * scrolling area once every frame period of simulated time, written
+ * as a PPM image if it changed, and the bytes, commands and SPI time
+ * of the frame are counted. */
+
+#include "FreeRTOS.h"
+
+#include "sim.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DISPLAY_W 128
+#define DISPLAY_H 160
+
+enum st7735_command {
+	ST7735_SWRESET = 0x01,
+	ST7735_SLPOUT  = 0x11,
+	ST7735_GAMSET  = 0x26,
+	ST7735_DISPOFF = 0x28,
+	ST7735_DISPON  = 0x29,
+	ST7735_CASET   = 0x2A,
+	ST7735_RASET   = 0x2B,
+	ST7735_RAMWR   = 0x2C,
+	ST7735_VSCRDEF = 0x33,
+	ST7735_MADCTL  = 0x36,
+	ST7735_VSCSAD  = 0x37,
+};
+
+// Counts of one frame
+struct frame_stats {
+	uint32_t bytes, commands, pixels, windows, scrolls;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	FILE *stats_out;
+
+	// Display memory
+	uint8_t mem[DISPLAY_H][DISPLAY_W][3];
+	int on;
+
+	// Command being received and its parameter bytes
+	uint8_t cmd;
+	unsigned nparam;
+	uint8_t param[6];
+
+	// Memory write window and position
+	unsigned xs, xe, ys, ye, x, y;
+	// Bytes of the pixel being written
+	uint8_t pixel[3];
+	unsigned npixel;
+
+	// Vertical scrolling definition and start address
+	unsigned tfa, vsa, bfa, ssa;
+
+	// Frames are counted from the start of the simulation
+	uint64_t frame, frame_steps;
+	int changed;
+	struct frame_stats cur, total, max;
+	uint32_t unknown_commands;
+} display = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+static void display_reset(void)
+{
+	display.on = 0;
+	display.xs = 0;
+	display.xe = DISPLAY_W - 1;
+	display.ys = 0;
+	display.ye = DISPLAY_H - 1;
+	display.x = display.y = 0;
+	display.tfa = 0;
+	display.vsa = DISPLAY_H;
+	display.bfa = 0;
+	display.ssa = 0;
+	display.changed = 1;
+}
+
+
+void sim_display_init(void)
+{
+	display.frame_steps = (uint64_t)sim_opt.frame_ms * SIM_FS / 1000;
+	if (sim_opt.display_stats != NULL) {
+		display.stats_out = sim_open(sim_opt.display_stats, "w");
+		fprintf(display.stats_out, "# frame ms bytes commands pixels windows scrolls spi_us\n");
+	}
+	display_reset();
+}
+
+
+/* ------------------
+ * Commands
+ * ------------------ */
+
+static unsigned param16(unsigned i)
+{
+	return (unsigned)display.param[i] << 8 | display.param[i + 1];
+}
+
+static void pixel_write(void)
+{
+	if (display.x < DISPLAY_W && display.y < DISPLAY_H)
+		memcpy(display.mem[display.y][display.x], display.pixel, 3);
+	display.cur.pixels++;
+	display.changed = 1;
+	// Window is filled row by row and starts again when full
+	if (++display.x > display.xe) {
+		display.x = display.xs;
+		if (++display.y > display.ye)
+			display.y = display.ys;
+	}
+}
+
+static void command_start(uint8_t cmd)
+{
+	display.cmd = cmd;
+	display.nparam = 0;
+	display.cur.commands++;
+	switch (cmd) {
+	case ST7735_SWRESET:
+		display_reset();
+		break;
+	case ST7735_SLPOUT:
+	case ST7735_GAMSET:
+	case ST7735_MADCTL:
+		// No effect on the memory or the image
+		break;
+	case ST7735_DISPOFF:
+	case ST7735_DISPON:
+		display.on = cmd == ST7735_DISPON;
+		display.changed = 1;
+		break;
+	case ST7735_RAMWR:
+		display.x = display.xs;
+		display.y = display.ys;
+		display.npixel = 0;
+		display.cur.windows++;
+		break;
+	case ST7735_CASET:
+	case ST7735_RASET:
+	case ST7735_VSCRDEF:
+	case ST7735_VSCSAD:
+		break;
+	default:
+		display.unknown_commands++;
+		break;
+	}
+}
+
+static void command_data(uint8_t b)
+{
+	if (display.cmd == ST7735_RAMWR) {
+		display.pixel[display.npixel++] = b;
+		if (display.npixel == 3) {
+			display.npixel = 0;
+			pixel_write();
+		}
+		return;
+	}
+	if (display.nparam >= sizeof(display.param))
+		return;
+	display.param[display.nparam++] = b;
+
+	switch (display.cmd) {
+	case ST7735_CASET:
+		if (display.nparam == 4) {
+			display.xs = param16(0);
+			display.xe = param16(2);
+		}
+		break;
+	case ST7735_RASET:
+		if (display.nparam == 4) {
+			display.ys = param16(0);
+			display.ye = param16(2);
+		}
+		break;
+	case ST7735_VSCRDEF:
+		if (display.nparam == 6) {
+			display.tfa = param16(0);
+			display.vsa = param16(2);
+			display.bfa = param16(4);
+			display.changed = 1;
+		}
+		break;
+	case ST7735_VSCSAD:
+		if (display.nparam == 2) {
+			display.ssa = param16(0);
+			display.cur.scrolls++;
+			display.changed = 1;
+		}
+		break;
+	}
+}
+
+/* Byte sent to the display. DC is 0 for a command, 1 for data. */
+void sim_display_byte(int dc, uint8_t b)
+{
+	// Interrupts are masked so that the report cannot interrupt this
+	uint32_t mask = ulPortSetInterruptMask();
+	pthread_mutex_lock(&display.lock);
+	display.cur.bytes++;
+	if (dc)
+		command_data(b);
+	else
+		command_start(b);
+	pthread_mutex_unlock(&display.lock);
+	vPortClearInterruptMask(mask);
+}
+
+
+/* ------------------
+ * Frames
+ * ------------------ */
+
+/* Memory row shown on a line of the screen. Lines in the
+ * scrolling area show the memory starting from the row
+ * at the scrolling start address. */
+static unsigned screen_row(unsigned line)
+{
+	unsigned tfa = display.tfa, vsa = display.vsa;
+	// Definitions not covering the screen are not used
+	if (vsa == 0 || tfa + vsa + display.bfa != DISPLAY_H)
+		return line;
+	if (line < tfa || line >= tfa + vsa || display.ssa < tfa || display.ssa >= tfa + vsa)
+		return line;
+	return tfa + (line - tfa + display.ssa - tfa) % vsa;
+}
+
+static void frame_write(void)
+{
+	char name[256];
+	static uint8_t screen[DISPLAY_H][DISPLAY_W][3];
+	unsigned line, x, c;
+	for (line = 0; line < DISPLAY_H; line++) {
+		const uint8_t (*row)[3] = display.mem[screen_row(line)];
+		for (x = 0; x < DISPLAY_W; x++) {
+			for (c = 0; c < 3; c++)
+				// Only the 6 upper bits of a color are used
+				screen[line][x][c] = display.on ? row[x][c] & 0xFC : 0;
+		}
+	}
+	snprintf(name, sizeof(name), "%s%05llu.ppm",
+		sim_opt.display_frames, (unsigned long long)display.frame);
+	FILE *f = sim_open(name, "wb");
+	fprintf(f, "P6\n%d %d\n255\n", DISPLAY_W, DISPLAY_H);
+	fwrite(screen, sizeof(screen), 1, f);
+	fclose(f);
+}
+
+static double spi_us(uint32_t bytes)
+{
+	return bytes * 8 * 1e6 / SIM_SPI_HZ;
+}
+
+static void stats_max(uint32_t *max, uint32_t v)
+{
+	if (v > *max)
+		*max = v;
+}
+
+static void frame_end(void)
+{
+	struct frame_stats *s = &display.cur;
+	if (display.stats_out != NULL) {
+		fprintf(display.stats_out, "%llu %llu %u %u %u %u %u %.1f\n",
+			(unsigned long long)display.frame,
+			(unsigned long long)(display.frame * display.frame_steps * 1000 / SIM_FS),
+			(unsigned)s->bytes, (unsigned)s->commands, (unsigned)s->pixels,
+			(unsigned)s->windows, (unsigned)s->scrolls, spi_us(s->bytes));
+	}
+	if (sim_opt.display_frames != NULL && display.changed)
+		frame_write();
+	display.changed = 0;
+
+	display.total.bytes += s->bytes;
+	display.total.commands += s->commands;
+	display.total.pixels += s->pixels;
+	display.total.windows += s->windows;
+	display.total.scrolls += s->scrolls;
+	stats_max(&display.max.bytes, s->bytes);
+	stats_max(&display.max.commands, s->commands);
+	stats_max(&display.max.pixels, s->pixels);
+	stats_max(&display.max.windows, s->windows);
+	stats_max(&display.max.scrolls, s->scrolls);
+	memset(s, 0, sizeof(*s));
+	display.frame++;
+}
+
+void sim_display_step(void)
+{
+	if (sim_samples % display.frame_steps != 0)
+		return;
+	pthread_mutex_lock(&display.lock);
+	frame_end();
+	pthread_mutex_unlock(&display.lock);
+}
+
+
+void sim_display_report(void)
+{
+	pthread_mutex_lock(&display.lock);
+	uint64_t n = display.frame ? display.frame : 1;
+	double frame_us = display.frame_steps * 1e6 / SIM_FS;
+	printf("Display: %llu frames of %u ms, per frame average and max:\n",
+		(unsigned long long)display.frame, sim_opt.frame_ms);
+	printf("Display:   %.0f/%u bytes, %.1f/%u commands, %.0f/%u pixels, "
+		"%.1f/%u windows, %.1f/%u scrolls\n",
+		(double)display.total.bytes / n, (unsigned)display.max.bytes,
+		(double)display.total.commands / n, (unsigned)display.max.commands,
+		(double)display.total.pixels / n, (unsigned)display.max.pixels,
+		(double)display.total.windows / n, (unsigned)display.max.windows,
+		(double)display.total.scrolls / n, (unsigned)display.max.scrolls);
+	printf("Display:   SPI busy %.0f/%.0f us, %.1f/%.1f %% of the frame\n",
+		spi_us(display.total.bytes) / n, spi_us(display.max.bytes),
+		100.0 * spi_us(display.total.bytes) / n / frame_us,
+		100.0 * spi_us(display.max.bytes) / frame_us);
+	if (display.unknown_commands)
+		printf("Display: %u unknown commands\n", (unsigned)display.unknown_commands);
+	if (display.stats_out != NULL)
+		fflush(display.stats_out);
+	pthread_mutex_unlock(&display.lock);
+}
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Host simulator running the whole firmware.
+ * See README.md for usage. */
+
+#include "em_device.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// rig
+#include "diagnostics.h"
+
+#include "sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// Calibration cache and settings flash pages at the end of the flash,
+// see railcal.c and settings.c, rounded up to host memory pages
+#define SIM_FLASH_SIZE 0x2000
+#define SIM_FLASH_BASE (FLASH_BASE + FLASH_SIZE - SIM_FLASH_SIZE)
+
+int firmware_main(void);
+
+struct sim_options sim_opt = {
+	.speed = 1.0,
+	.frame_ms = 100,
+};
+
+
+uint64_t sim_wall_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+FILE *sim_open(const char *name, const char *mode)
+{
+	FILE *f = fopen(name, mode);
+	if (f == NULL) {
+		perror(name);
+		exit(2);
+	}
+	return f;
+}
+
+
+/* Map memory at the address of a device memory region */
+static void *sim_map(uintptr_t addr, size_t size, int fd)
+{
+	void *p = mmap((void *)addr, size, PROT_READ | PROT_WRITE,
+		MAP_FIXED_NOREPLACE | (fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED),
+		fd, 0);
+	if (p != (void *)addr) {
+		fprintf(stderr, "Cannot map %08lx: %s\n", (unsigned long)addr, strerror(errno));
+		exit(1);
+	}
+	return p;
+}
+
+
+static void sim_map_memory(void)
+{
+	// Peripherals, including the bit set and clear aliases written by DMA
+	sim_map(PER_MEM_BASE, 0x100000, -1);
+	// Core peripherals: SysTick, NVIC, SCB, DWT
+	sim_map(0xE0000000, 0x100000, -1);
+	// Device information and user data pages
+	memset(sim_map(0x0FE00000, 0x10000, -1), 0xFF, 0x10000);
+
+	if (sim_opt.flash != NULL) {
+		int fd = open(sim_opt.flash, O_RDWR | O_CREAT, 0644);
+		if (fd < 0) {
+			perror(sim_opt.flash);
+			exit(2);
+		}
+		off_t size = lseek(fd, 0, SEEK_END);
+		if (size < SIM_FLASH_SIZE && ftruncate(fd, SIM_FLASH_SIZE) != 0) {
+			perror(sim_opt.flash);
+			exit(2);
+		}
+		void *p = sim_map(SIM_FLASH_BASE, SIM_FLASH_SIZE, fd);
+		// New file, or the part added to a shorter one, is erased flash
+		if (size < SIM_FLASH_SIZE)
+			memset((char *)p + size, 0xFF, SIM_FLASH_SIZE - size);
+	} else {
+		memset(sim_map(SIM_FLASH_BASE, SIM_FLASH_SIZE, -1), 0xFF, SIM_FLASH_SIZE);
+	}
+}
+
+
+/* Firmware prints from tasks and interrupts alike,
+ * so standard output is used with interrupts masked. */
+int __real_puts(const char *s);
+int __real_putchar(int c);
+
+int __wrap_printf(const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	uint32_t mask = ulPortSetInterruptMask();
+	int r = vprintf(format, ap);
+	vPortClearInterruptMask(mask);
+	va_end(ap);
+	return r;
+}
+
+int __wrap_puts(const char *s)
+{
+	uint32_t mask = ulPortSetInterruptMask();
+	int r = __real_puts(s);
+	vPortClearInterruptMask(mask);
+	return r;
+}
+
+int __wrap_putchar(int c)
+{
+	uint32_t mask = ulPortSetInterruptMask();
+	int r = __real_putchar(c);
+	vPortClearInterruptMask(mask);
+	return r;
+}
+
+
+static void report_tasks(void)
+{
+	TaskStatus_t tasks[16];
+	uint32_t total;
+	UBaseType_t i, n = uxTaskGetSystemState(tasks, 16, &total);
+	printf("%-12s %10s %6s %10s\n", "Task", "Cycles", "CPU %", "Stack free");
+	for (i = 0; i < n; i++) {
+		printf("%-12s %10lu %6.1f %10u\n",
+			tasks[i].pcTaskName,
+			(unsigned long)tasks[i].ulRunTimeCounter,
+			total ? 100.0 * tasks[i].ulRunTimeCounter / total : 0.0,
+			(unsigned)tasks[i].usStackHighWaterMark);
+	}
+}
+
+
+void sim_report(void)
+{
+	static const char *const irq_names[SIM_IRQS] = {
+		"RAIL", "TIMER1", "LDMA", "GPIO_EVEN", "GPIO_ODD", "halt"
+	};
+	double wall = (sim_wall_ns() - sim_stats.start_ns) * 1e-9;
+	unsigned i;
+	printf("\nSimulated %.3f s in %.3f s, %llu late steps\n",
+		sim_seconds(), wall, (unsigned long long)sim_stats.late_samples);
+	printf("%-10s %10s %10s\n", "Interrupt", "Raised", "Overruns");
+	for (i = 0; i < SIM_IRQS; i++)
+		printf("%-10s %10u %10u\n", irq_names[i],
+			(unsigned)sim_stats.irqs[i], (unsigned)sim_stats.overruns[i]);
+
+	printf("Receive blocks:  %u sent, %u processed, %u overflows, %u underruns, queue max %u\n",
+		(unsigned)diag.rx_blocks_isr, (unsigned)diag.rx_blocks_task,
+		(unsigned)diag.rx_blocks_overflow, (unsigned)diag.rx_rail_underruns,
+		(unsigned)diag.rx_queue_max);
+	printf("Transmit blocks: %u sent, %u processed, %u overflows, queue max %u\n",
+		(unsigned)diag.tx_blocks_isr, (unsigned)diag.tx_blocks_task,
+		(unsigned)diag.tx_blocks_overflow, (unsigned)diag.tx_queue_max);
+	printf("Fast DSP CPU use %.1f %%, interrupts %.1f %%\n",
+		diag.dsp_cpu_use * 100.0,
+		sim_samples ? 100.0 * diag.cycles_isr / ((double)sim_samples * SIM_CYCLES_PER_SAMPLE) : 0.0);
+	printf("Waterfall: %u lines drawn, %u dropped\n",
+		(unsigned)diag.waterfall_lines_drawn, (unsigned)diag.waterfall_lines_dropped);
+	printf("Retunes: %u fast, %u full, max %u us\n",
+		(unsigned)diag.retunes_fast, (unsigned)diag.retunes_full,
+		(unsigned)diag.retune_us_max);
+	printf("PTT to transmit %u us, unkey to receive %u us\n",
+		(unsigned)diag.ptt_tx_us, (unsigned)diag.unkey_rx_us);
+	// WFI returns at once in the simulator, so its count is not shown
+	printf("Idle: %u tickless sleeps of %u ticks, %u aborted\n",
+		(unsigned)diag.sleep_tickless, (unsigned)diag.sleep_ticks,
+		(unsigned)diag.sleep_aborted);
+	sim_rail_report();
+	sim_periph_report();
+	sim_display_report();
+}
+
+
+static void halt_irq(void)
+{
+	sim_report();
+	report_tasks();
+	fflush(stdout);
+	exit(0);
+}
+
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t seconds   simulated time to run, 0 to run until quit\n"
+		"  -x speed     simulated time per wall clock time\n"
+		"  -i file      received IQ samples\n"
+		"  -m file      microphone ADC samples at 24 kHz\n"
+		"  -e file      input events\n"
+		"  -a file      write audio output samples while receiving\n"
+		"  -f file      write synthesizer channels while transmitting\n"
+		"  -s file      settings and calibration flash contents, created if missing\n"
+		"  -l file      write the radio log\n"
+		"  -r rate      received IQ sample rate, 48000 by default\n"
+		"  -L c,o,i,r,t radio timing in microseconds: channel configuration,\n"
+		"               frequency offset, idle, receive and transmit warm-up\n"
+		"  -d prefix    write display frames to prefixNNNNN.ppm\n"
+		"  -D file      write display counts of each frame\n"
+		"  -p ms        display frame period, 100 by default\n",
+		name);
+	exit(2);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int c;
+	while ((c = getopt(argc, argv, "t:x:i:m:e:a:f:s:l:r:L:d:D:p:")) != -1) {
+		switch (c) {
+		case 't': sim_opt.seconds = atof(optarg); break;
+		case 'x': sim_opt.speed = atof(optarg); break;
+		case 'i': sim_opt.iq_in = optarg; break;
+		case 'm': sim_opt.mic_in = optarg; break;
+		case 'e': sim_opt.events = optarg; break;
+		case 'a': sim_opt.audio_out = optarg; break;
+		case 'f': sim_opt.fm_out = optarg; break;
+		case 's': sim_opt.flash = optarg; break;
+		case 'l': sim_opt.rail_log = optarg; break;
+		case 'r': sim_rail_model.rx_rate = atoi(optarg); break;
+		case 'L':
+			if (sscanf(optarg, "%u,%u,%u,%u,%u",
+				&sim_rail_model.config_channels_us,
+				&sim_rail_model.freq_offset_us,
+				&sim_rail_model.idle_us,
+				&sim_rail_model.rx_warmup_us,
+				&sim_rail_model.tx_warmup_us) != 5)
+				usage(argv[0]);
+			break;
+		case 'd': sim_opt.display_frames = optarg; break;
+		case 'D': sim_opt.display_stats = optarg; break;
+		case 'p': sim_opt.frame_ms = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind != argc || sim_opt.speed <= 0 || sim_opt.frame_ms == 0)
+		usage(argv[0]);
+
+	// Output is followed as the simulation runs
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	sim_map_memory();
+	sim_periph_init();
+	sim_rail_init();
+	sim_display_init();
+	vPortSetInterruptHandler(SIM_IRQ_HALT, halt_irq);
+	sim_clock_start();
+	return firmware_main();
+}
@@ -0,0 +1,521 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Simulated peripherals.
+ *
+ * Registers are plain memory, so inline emlib functions work as they
+ * are. The emlib functions which are not inline are replaced here,
+ * and each simulation step does what the hardware would do on its own:
+ * the sample timer interrupt with an ADC conversion, the end of display
+ * DMA transfers and write-1-to-clear interrupt flags. */
+
+#include "em_device.h"
+#include "em_adc.h"
+#include "em_cmu.h"
+#include "em_emu.h"
+#include "em_gpio.h"
+#include "em_ldma.h"
+#include "em_msc.h"
+#include "em_opamp.h"
+#include "em_system.h"
+#include "em_timer.h"
+#include "em_usart.h"
+#include "em_vdac.h"
+
+#include "FreeRTOS.h"
+
+// rig
+#include "InitDevice.h"
+#include "power.h"
+#include "dsp.h"
+
+#include "sim.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Display SPI clock
+
+// Synthesizer channel register written by the sample timer interrupt
+#define SYNTH_CHANNEL (*(volatile uint32_t *)0x40083038)
+
+void TIMER1_IRQHandler(void);
+void LDMA_IRQHandler(void);
+void GPIO_EVEN_IRQHandler(void);
+void GPIO_ODD_IRQHandler(void);
+
+static struct {
+	FILE *mic_in, *audio_out, *fm_out;
+
+	pthread_mutex_t ldma_lock;
+	// Step when the transfer in flight is done, 0 if none
+	uint64_t ldma_done_at;
+	// Channels which interrupt when it is done
+	uint32_t ldma_done_ifs;
+	// Bytes sent in the transfer being started
+	uint32_t ldma_bytes;
+
+	// Bytes sent to the display and DMA transfers started
+	uint64_t spi_bytes, ldma_transfers;
+} periph = { .ldma_lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+/* ----------------------------
+ * Interrupts and their flags
+ * ---------------------------- */
+
+/* NVIC enable registers are write 1 to set and write 1 to clear,
+ * but plain memory keeps only the last value written, so enabled
+ * interrupts are kept here and the registers are updated from them. */
+static uint32_t nvic_enable[sizeof(NVIC->ISER) / sizeof(NVIC->ISER[0])];
+
+static void nvic_update(void)
+{
+	unsigned i;
+	for (i = 0; i < sizeof(nvic_enable) / sizeof(nvic_enable[0]); i++) {
+		uint32_t set = NVIC->ISER[i];
+		nvic_enable[i] |= set;
+		nvic_enable[i] &= ~__atomic_exchange_n(&NVIC->ICER[i], 0, __ATOMIC_SEQ_CST);
+		// A write between the read and here is seen on the next step
+		__atomic_compare_exchange_n(&NVIC->ISER[i], &set, nvic_enable[i],
+			0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	}
+}
+
+static int nvic_enabled(IRQn_Type irq)
+{
+	return (nvic_enable[irq >> 5] >> (irq & 31)) & 1;
+}
+
+// Interrupt flags are read-only registers,
+// changed by the simulation thread too
+static void flags_set(volatile const uint32_t *flags, uint32_t set)
+{
+	__atomic_fetch_or((volatile uint32_t *)flags, set, __ATOMIC_SEQ_CST);
+}
+
+static void flags_clear(volatile const uint32_t *flags, volatile uint32_t *ifc)
+{
+	uint32_t clear = __atomic_exchange_n(ifc, 0, __ATOMIC_SEQ_CST);
+	__atomic_fetch_and((volatile uint32_t *)flags, ~clear, __ATOMIC_SEQ_CST);
+}
+
+static void timer1_irq(void)
+{
+	TIMER1_IRQHandler();
+	flags_clear(&TIMER1->IF, &TIMER1->IFC);
+}
+
+static void ldma_irq(void)
+{
+	LDMA_IRQHandler();
+	flags_clear(&LDMA->IF, &LDMA->IFC);
+}
+
+static void gpio_even_irq(void)
+{
+	GPIO_EVEN_IRQHandler();
+	flags_clear(&GPIO->IF, &GPIO->IFC);
+}
+
+static void gpio_odd_irq(void)
+{
+	GPIO_ODD_IRQHandler();
+	flags_clear(&GPIO->IF, &GPIO->IFC);
+}
+
+
+/* ------------------
+ * Simulation steps
+ * ------------------ */
+
+void sim_periph_init(void)
+{
+	unsigned i;
+	// Inputs are pulled up, so buttons are not pressed
+	for (i = 0; i < GPIO_PORT_MAX + 1; i++)
+		SIM_REG(GPIO->P[i].DIN) = 0xFFFF;
+
+	if (sim_opt.mic_in != NULL)
+		periph.mic_in = sim_open(sim_opt.mic_in, "rb");
+	if (sim_opt.audio_out != NULL)
+		periph.audio_out = sim_open(sim_opt.audio_out, "wb");
+	if (sim_opt.fm_out != NULL)
+		periph.fm_out = sim_open(sim_opt.fm_out, "wb");
+
+	vPortSetInterruptHandler(SIM_IRQ_TIMER1, timer1_irq);
+	vPortSetInterruptHandler(SIM_IRQ_LDMA, ldma_irq);
+	vPortSetInterruptHandler(SIM_IRQ_GPIO_EVEN, gpio_even_irq);
+	vPortSetInterruptHandler(SIM_IRQ_GPIO_ODD, gpio_odd_irq);
+}
+
+
+/* Microphone sample from the file, which is read again from
+ * the start when it ends. Without a file, the input is silent. */
+static uint16_t mic_sample(void)
+{
+	uint16_t v = 1 << 14;
+	if (periph.mic_in != NULL && fread(&v, sizeof(v), 1, periph.mic_in) != 1) {
+		rewind(periph.mic_in);
+		if (fread(&v, sizeof(v), 1, periph.mic_in) != 1)
+			v = 1 << 14;
+	}
+	return v;
+}
+
+
+void sim_periph_step(void)
+{
+	nvic_update();
+
+	// Sample timer during transmission
+	if ((TIMER1->IEN & TIMER_IEN_CC0) && nvic_enabled(TIMER1_IRQn)) {
+		if (periph.fm_out != NULL) {
+			fm_out_t ch = SYNTH_CHANNEL;
+			fwrite(&ch, sizeof(ch), 1, periph.fm_out);
+		}
+		// Conversion started in the previous interrupt is ready
+		if (ADC0->CMD & ADC_CMD_SINGLESTART) {
+			ADC0->CMD = 0;
+			SIM_REG(ADC0->SINGLEDATA) = mic_sample();
+		}
+		flags_set(&TIMER1->IF, TIMER_IF_CC0);
+		sim_raise(SIM_IRQ_TIMER1);
+	}
+
+	// PWM audio output during reception
+	if (periph.audio_out != NULL && sim_rail_receiving()) {
+		audio_out_t a = TIMER0->CC[0].CCVB;
+		fwrite(&a, sizeof(a), 1, periph.audio_out);
+	}
+
+	pthread_mutex_lock(&periph.ldma_lock);
+	if (periph.ldma_done_at != 0 && sim_samples >= periph.ldma_done_at) {
+		uint32_t ifs = periph.ldma_done_ifs;
+		periph.ldma_done_at = 0;
+		periph.ldma_done_ifs = 0;
+		LDMA->CHDONE |= ifs;
+		flags_set(&LDMA->IF, ifs);
+		if (LDMA->IEN & ifs)
+			sim_raise(SIM_IRQ_LDMA);
+	}
+	pthread_mutex_unlock(&periph.ldma_lock);
+}
+
+
+/* Change the level of an input pin and
+ * interrupt if it is enabled for the pin.
+ * A negative level only interrupts, for pins read by PCNT. */
+void sim_gpio_input(unsigned port, unsigned pin, int level)
+{
+	if (level == 0)
+		SIM_REG(GPIO->P[port].DIN) &= ~(1u << pin);
+	else if (level > 0)
+		SIM_REG(GPIO->P[port].DIN) |= 1u << pin;
+
+	// ui_hw.c uses the pin number as the interrupt number
+	if (GPIO->IEN & (1u << pin)) {
+		flags_set(&GPIO->IF, 1u << pin);
+		if (pin % 2 == 0 && nvic_enabled(GPIO_EVEN_IRQn))
+			sim_raise(SIM_IRQ_GPIO_EVEN);
+		if (pin % 2 == 1 && nvic_enabled(GPIO_ODD_IRQn))
+			sim_raise(SIM_IRQ_GPIO_ODD);
+	}
+}
+
+
+void sim_periph_report(void)
+{
+	printf("Display: %llu DMA transfers, %llu bytes\n",
+		(unsigned long long)periph.ldma_transfers,
+		(unsigned long long)periph.spi_bytes);
+}
+
+
+/* ------------------
+ * Display SPI and DMA
+ * ------------------ */
+
+static void spi_byte(uint8_t b)
+{
+	// Display ignores bytes while not selected
+	if (!(GPIO->P[TFT_CS_PORT].DOUT & (1 << TFT_CS_PIN)))
+		sim_display_byte((GPIO->P[TFT_DC_PORT].DOUT >> TFT_DC_PIN) & 1, b);
+	periph.spi_bytes++;
+	periph.ldma_bytes++;
+}
+
+
+uint8_t USART_SpiTransfer(USART_TypeDef *usart, uint8_t data)
+{
+	if (usart == USART1)
+		spi_byte(data);
+	return 0;
+}
+
+
+static void ldma_run(int ch, const LDMA_Descriptor_t *d);
+
+/* WRITE descriptor. Only the targets used by display.c are known. */
+static void ldma_write(uint32_t addr, uint32_t value)
+{
+	if (addr == (uint32_t)(uintptr_t)&LDMA->LINKLOAD) {
+		int ch;
+		for (ch = 0; ch < DMA_CHAN_COUNT; ch++) {
+			if (value & (1u << ch))
+				ldma_run(ch, (const LDMA_Descriptor_t *)(uintptr_t)
+					(LDMA->CH[ch].LINK & _LDMA_CH_LINK_LINKADDR_MASK));
+		}
+	} else if (addr >= PER_BITSET_MEM_BASE && addr < PER_BITSET_MEM_BASE + 0x100000) {
+		*(volatile uint32_t *)(uintptr_t)(addr - PER_BITSET_MEM_BASE + PER_MEM_BASE) |= value;
+	} else if (addr >= PER_BITCLR_MEM_BASE && addr < PER_BITCLR_MEM_BASE + 0x100000) {
+		*(volatile uint32_t *)(uintptr_t)(addr - PER_BITCLR_MEM_BASE + PER_MEM_BASE) &= ~value;
+	} else {
+		*(volatile uint32_t *)(uintptr_t)addr = value;
+	}
+}
+
+
+/* Run a descriptor chain at once. Bytes go to the display
+ * and writes are done in order, so the DC pin is right for
+ * every byte. Completion is timed from the number of bytes. */
+static void ldma_run(int ch, const LDMA_Descriptor_t *d)
+{
+	unsigned n;
+	for (n = 0; d != NULL && n < 1000; n++) {
+		if (d->xfer.structType == ldmaCtrlStructTypeXfer
+			&& d->xfer.dstAddr == (uint32_t)(uintptr_t)&USART1->TXDATA) {
+			const uint8_t *src = (const uint8_t *)(uintptr_t)d->xfer.srcAddr;
+			unsigned i, inc = d->xfer.srcInc == ldmaCtrlSrcIncNone ? 0 : 1;
+			for (i = 0; i <= d->xfer.xferCnt; i++)
+				spi_byte(src[i * inc]);
+		} else if (d->xfer.structType == ldmaCtrlStructTypeWrite) {
+			ldma_write(d->wri.dstAddr, d->wri.immVal);
+		}
+		// Other transfers only wait for the USART in display.c
+
+		if (d->xfer.doneIfs)
+			periph.ldma_done_ifs |= 1u << ch;
+		if (!d->xfer.link)
+			break;
+		if (d->xfer.linkMode == ldmaLinkModeRel)
+			d += d->xfer.linkAddr / 4;
+		else
+			d = (const LDMA_Descriptor_t *)(uintptr_t)((uint32_t)d->xfer.linkAddr << 2);
+	}
+}
+
+
+void LDMA_StartTransfer(int ch, const LDMA_TransferCfg_t *transfer,
+	const LDMA_Descriptor_t *descriptor)
+{
+	(void)transfer;
+	pthread_mutex_lock(&periph.ldma_lock);
+	// Registers are set up like emlib does
+	LDMA->CH[ch].LINK = (uint32_t)(uintptr_t)descriptor & _LDMA_CH_LINK_LINKADDR_MASK;
+	LDMA->IFC |= 1u << ch;
+	flags_clear(&LDMA->IF, &LDMA->IFC);
+	LDMA->IEN |= 1u << ch;
+	periph.ldma_bytes = 0;
+	ldma_run(ch, descriptor);
+	uint64_t start = periph.ldma_done_at > sim_samples ? periph.ldma_done_at : sim_samples;
+	periph.ldma_done_at = start + 1
+		+ (uint64_t)periph.ldma_bytes * 8 * SIM_FS / SIM_SPI_HZ;
+	periph.ldma_transfers++;
+	pthread_mutex_unlock(&periph.ldma_lock);
+}
+
+
+void LDMA_StopTransfer(int ch)
+{
+	pthread_mutex_lock(&periph.ldma_lock);
+	periph.ldma_done_ifs &= ~(1u << ch);
+	if (periph.ldma_done_ifs == 0)
+		periph.ldma_done_at = 0;
+	pthread_mutex_unlock(&periph.ldma_lock);
+}
+
+
+void LDMA_Init(const LDMA_Init_t *init)
+{
+	(void)init;
+	NVIC_EnableIRQ(LDMA_IRQn);
+}
+
+
+/* ------------------
+ * Flash
+ * ------------------ */
+
+void MSC_Init(void)
+{
+}
+
+
+// Programming can only clear bits
+MSC_Status_TypeDef MSC_WriteWord(uint32_t *address, void const *data, uint32_t numBytes)
+{
+	const uint8_t *d = data;
+	uint32_t i;
+	for (i = 0; i < numBytes / 4; i++) {
+		uint32_t w;
+		memcpy(&w, d + 4 * i, 4);
+		address[i] &= w;
+	}
+	return mscReturnOk;
+}
+
+
+MSC_Status_TypeDef MSC_ErasePage(uint32_t *startAddress)
+{
+	memset((void *)((uintptr_t)startAddress & ~(uintptr_t)(FLASH_PAGE_SIZE - 1)),
+		0xFF, FLASH_PAGE_SIZE);
+	return mscReturnOk;
+}
+
+
+/* ------------------------------------
+ * Setup functions with nothing to do
+ * ------------------------------------ */
+
+void enter_DefaultMode_from_RESET(void)
+{
+}
+
+// Used by CHIP_Init on EFR32MG1
+void SYSTEM_ChipRevisionGet(SYSTEM_ChipRevision_TypeDef *rev)
+{
+	rev->major = 0;
+	rev->minor = 0;
+}
+
+uint32_t SystemCoreClockGet(void)
+{
+	return 38400000;
+}
+
+void CMU_ClockEnable(CMU_Clock_TypeDef clock, bool enable)
+{
+	(void)clock;
+	(void)enable;
+}
+
+void GPIO_PinModeSet(GPIO_Port_TypeDef port, unsigned int pin,
+	GPIO_Mode_TypeDef mode, unsigned int out)
+{
+	(void)mode;
+	if (out)
+		GPIO->P[port].DOUT |= 1u << pin;
+	else
+		GPIO->P[port].DOUT &= ~(1u << pin);
+}
+
+void GPIO_ExtIntConfig(GPIO_Port_TypeDef port, unsigned int pin,
+	unsigned int intNo, bool risingEdge, bool fallingEdge, bool enable)
+{
+	(void)port;
+	(void)pin;
+	(void)risingEdge;
+	(void)fallingEdge;
+	if (enable)
+		GPIO->IEN |= 1u << intNo;
+	else
+		GPIO->IEN &= ~(1u << intNo);
+}
+
+void TIMER_Init(TIMER_TypeDef *timer, const TIMER_Init_TypeDef *init)
+{
+	(void)timer;
+	(void)init;
+}
+
+void TIMER_InitCC(TIMER_TypeDef *timer, unsigned int ch, const TIMER_InitCC_TypeDef *init)
+{
+	(void)timer;
+	(void)ch;
+	(void)init;
+}
+
+void ADC_Init(ADC_TypeDef *adc, const ADC_Init_TypeDef *init)
+{
+	(void)adc;
+	(void)init;
+}
+
+void ADC_InitSingle(ADC_TypeDef *adc, const ADC_InitSingle_TypeDef *init)
+{
+	(void)adc;
+	(void)init;
+}
+
+uint8_t ADC_TimebaseCalc(uint32_t hfperFreq)
+{
+	(void)hfperFreq;
+	return 0;
+}
+
+uint8_t ADC_PrescaleCalc(uint32_t adcFreq, uint32_t hfperFreq)
+{
+	(void)adcFreq;
+	(void)hfperFreq;
+	return 0;
+}
+
+#ifdef USE_OPAMPS
+void VDAC_Init(VDAC_TypeDef *vdac, const VDAC_Init_TypeDef *init)
+{
+	(void)vdac;
+	(void)init;
+}
+
+void VDAC_Enable(VDAC_TypeDef *vdac, unsigned int ch, bool enable)
+{
+	(void)vdac;
+	(void)ch;
+	(void)enable;
+}
+
+void OPAMP_Enable(VDAC_TypeDef *dac, OPAMP_TypeDef opa, const OPAMP_Init_TypeDef *init)
+{
+	(void)dac;
+	(void)opa;
+	(void)init;
+}
+#endif
+
+float EMU_TemperatureGet(void)
+{
+	return 25.0f;
+}
+
+
+/* ------------------------------
+ * Power management, see power.c
+ * ------------------------------ */
+
+void maybe_sleep(void)
+{
+}
+
+void shutdown(void)
+{
+	printf("Shutdown\n");
+	sim_report();
+	exit(0);
+}
+
+
+/* C version of the assembly function in CMSIS DSP */
+void arm_bitreversal_32(uint32_t *pSrc, const uint16_t bitRevLen, const uint16_t *pBitRevTab)
+{
+	unsigned i;
+	for (i = 0; i < bitRevLen; i += 2) {
+		unsigned a = pBitRevTab[i] >> 2, b = pBitRevTab[i + 1] >> 2;
+		uint32_t t = pSrc[a];
+		pSrc[a] = pSrc[b];
+		pSrc[b] = t;
+		t = pSrc[a + 1];
+		pSrc[a + 1] = pSrc[b + 1];
+		pSrc[b + 1] = t;
+	}
+}
@@ -0,0 +1,521 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Simulated RAIL library.
+ *
+ * Only the parts used by the firmware are there. While receiving,
+ * the receive FIFO fills with IQ samples at the configured rate and
+ * RAIL_EVENT_RX_FIFO_ALMOST_FULL is raised from a simulated interrupt
+ * when the FIFO reaches its threshold, the same way as on the device.
+ *
+ * Calls which take time on the device keep the calling task busy for
+ * a modelled time, so the firmware's own latency measurements see it,
+ * and the radio starts receiving or transmitting after a warm-up time.
+ * Every call which changes the radio state and every write to the
+ * synthesizer registers are written to the radio log with their
+ * simulated time. The times from a PTT input changing to the radio
+ * being on air or receiving again are measured from the same events. */
+
+#include "rail.h"
+
+#include "FreeRTOS.h"
+
+// rig
+#include "dsp.h"
+
+#include "sim.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <string.h>
+
+// Receive FIFO size in bytes
+#define RX_FIFO_BYTES 512
+
+// Synthesizer channel and channel spacing registers
+#define SYNTH_CHANNEL (*(volatile uint32_t *)0x40083038)
+#define SYNTH_CHSP    (*(volatile uint32_t *)0x4008303c)
+
+enum radio_state {
+	RADIO_IDLE,
+	// Started, waiting for the warm-up time
+	RADIO_RX_WARMUP,
+	RADIO_TX_WARMUP,
+	RADIO_RX,
+	RADIO_TX,
+};
+
+static struct {
+	RAIL_Config_t *config;
+	RAIL_Events_t events;
+	enum radio_state state;
+	// Step when the warm-up ends
+	uint64_t ready_at;
+
+	FILE *iq_in, *log;
+	pthread_mutex_t log_lock;
+	uint32_t noise;
+
+	// Bytes in the receive FIFO, added by the simulation thread
+	// and read by the interrupt
+	unsigned rx_fifo;
+	unsigned rx_threshold;
+	// Set when the FIFO has been below the threshold or has been
+	// read since the event, so being at the threshold raises it
+	int rx_armed;
+	// Fraction of a sample received, in 1/SIM_FS samples
+	unsigned rx_phase;
+
+	// Synthesizer registers at the previous step
+	uint32_t synth_channel, synth_chsp;
+
+	// Step of the latest PTT change, 0 once the radio has followed it
+	uint64_t ptt_at;
+	int ptt_keyed;
+	// Step of the first configuration call of a retune,
+	// 0 once the radio runs again
+	uint64_t retune_at;
+
+	struct {
+		uint32_t rx_starts, tx_starts, configs, offsets;
+		uint32_t rx_overflow_bytes, synth_writes_tx;
+		// Latest and largest latencies in steps
+		uint64_t ptt_tx, ptt_tx_max, unkey_rx, unkey_rx_max;
+		uint64_t retune, retune_max;
+	} stats;
+} sim_rail = {
+	.log_lock = PTHREAD_MUTEX_INITIALIZER,
+	.rx_threshold = RX_FIFO_BYTES,
+};
+
+/* Rough figures which should be replaced
+ * by ones measured on the device */
+struct sim_rail_model sim_rail_model = {
+	.rx_rate = 48000,
+	.config_channels_us = 1000,
+	.freq_offset_us = 20,
+	.idle_us = 10,
+	.rx_warmup_us = 100,
+	.tx_warmup_us = 100,
+};
+
+static void rail_irq(void)
+{
+	if (sim_rail.config != NULL && sim_rail.config->eventsCallback != NULL
+		&& (sim_rail.events & RAIL_EVENT_RX_FIFO_ALMOST_FULL))
+		sim_rail.config->eventsCallback(sim_rail.config,
+			RAIL_EVENT_RX_FIFO_ALMOST_FULL);
+}
+
+
+/* ------------------
+ * Radio log
+ * ------------------ */
+
+static double steps_us(uint64_t steps)
+{
+	return steps * 1e6 / SIM_FS;
+}
+
+static uint64_t us_steps(unsigned us)
+{
+	return ((uint64_t)us * SIM_FS + 999999) / 1000000;
+}
+
+static void rail_log(const char *format, ...)
+	__attribute__((format(printf, 1, 2)));
+
+static void rail_log(const char *format, ...)
+{
+	if (sim_rail.log == NULL)
+		return;
+	va_list ap;
+	va_start(ap, format);
+	uint32_t mask = ulPortSetInterruptMask();
+	pthread_mutex_lock(&sim_rail.log_lock);
+	fprintf(sim_rail.log, "%11.1f ", steps_us(sim_samples));
+	vfprintf(sim_rail.log, format, ap);
+	fputc('\n', sim_rail.log);
+	pthread_mutex_unlock(&sim_rail.log_lock);
+	vPortClearInterruptMask(mask);
+	va_end(ap);
+}
+
+
+/* Keep the calling task busy, like a RAIL call waiting for
+ * the radio hardware. Interrupts are handled meanwhile.
+ * Time only advances in whole steps. */
+static void rail_busy(unsigned us)
+{
+	if (xPortInIsr() || !xPortSchedulerRunning())
+		return;
+	uint64_t end = sim_samples + us_steps(us);
+	while (sim_samples < end)
+		sched_yield();
+}
+
+
+/* Latency which ends now */
+static void latency_end(uint64_t *start, uint64_t *latest, uint64_t *max, const char *name)
+{
+	if (*start == 0)
+		return;
+	*latest = sim_samples - *start;
+	if (*latest > *max)
+		*max = *latest;
+	*start = 0;
+	rail_log("%s %.1f us", name, steps_us(*latest));
+}
+
+
+/* ------------------
+ * Simulation steps
+ * ------------------ */
+
+void sim_rail_init(void)
+{
+	if (sim_opt.iq_in != NULL)
+		sim_rail.iq_in = sim_open(sim_opt.iq_in, "rb");
+	if (sim_opt.rail_log != NULL)
+		sim_rail.log = sim_open(sim_opt.rail_log, "w");
+	sim_rail.noise = 1;
+	vPortSetInterruptHandler(SIM_IRQ_RAIL, rail_irq);
+}
+
+
+static void rx_fill(void)
+{
+	sim_rail.rx_phase += sim_rail_model.rx_rate;
+	unsigned bytes = sim_rail.rx_phase / SIM_FS * sizeof(iq_in_t);
+	sim_rail.rx_phase %= SIM_FS;
+
+	unsigned level = __atomic_load_n(&sim_rail.rx_fifo, __ATOMIC_SEQ_CST);
+	if (level < sim_rail.rx_threshold)
+		__atomic_store_n(&sim_rail.rx_armed, 1, __ATOMIC_SEQ_CST);
+	if (level + bytes > RX_FIFO_BYTES) {
+		unsigned dropped = level + bytes - RX_FIFO_BYTES;
+		if (sim_rail.stats.rx_overflow_bytes == 0)
+			rail_log("rx_fifo_overflow");
+		sim_rail.stats.rx_overflow_bytes += dropped;
+		bytes -= dropped;
+	}
+	level = __atomic_add_fetch(&sim_rail.rx_fifo, bytes, __ATOMIC_SEQ_CST);
+	if (level >= sim_rail.rx_threshold
+		&& __atomic_exchange_n(&sim_rail.rx_armed, 0, __ATOMIC_SEQ_CST))
+		sim_raise(SIM_IRQ_RAIL);
+}
+
+
+static void radio_ready(enum radio_state state)
+{
+	rail_log(state == RADIO_RX ? "rx_on" : "tx_on");
+	latency_end(&sim_rail.retune_at, &sim_rail.stats.retune,
+		&sim_rail.stats.retune_max, "retune_done");
+	if (state == RADIO_TX && sim_rail.ptt_keyed)
+		latency_end(&sim_rail.ptt_at, &sim_rail.stats.ptt_tx,
+			&sim_rail.stats.ptt_tx_max, "ptt_to_tx");
+	if (state == RADIO_RX && !sim_rail.ptt_keyed)
+		latency_end(&sim_rail.ptt_at, &sim_rail.stats.unkey_rx,
+			&sim_rail.stats.unkey_rx_max, "unkey_to_rx");
+}
+
+
+void sim_rail_step(void)
+{
+	uint32_t ch = SYNTH_CHANNEL, chsp = SYNTH_CHSP;
+	// Radio state is changed by tasks, so it is only
+	// changed here if it is still the same
+	enum radio_state state = __atomic_load_n(&sim_rail.state, __ATOMIC_SEQ_CST);
+
+	// While transmitting, the channel register is the FM modulation
+	if (ch != sim_rail.synth_channel) {
+		if (state == RADIO_TX)
+			sim_rail.stats.synth_writes_tx++;
+		else
+			rail_log("synth_channel %u", (unsigned)ch);
+		sim_rail.synth_channel = ch;
+	}
+	if (chsp != sim_rail.synth_chsp) {
+		rail_log("synth_chsp %u", (unsigned)chsp);
+		sim_rail.synth_chsp = chsp;
+	}
+
+	if ((state == RADIO_RX_WARMUP || state == RADIO_TX_WARMUP)
+		&& sim_samples >= sim_rail.ready_at) {
+		enum radio_state on = state == RADIO_RX_WARMUP ? RADIO_RX : RADIO_TX;
+		if (__atomic_compare_exchange_n(&sim_rail.state, &state, on,
+			0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			state = on;
+			radio_ready(state);
+		}
+	}
+
+	if (state == RADIO_RX)
+		rx_fill();
+}
+
+
+/* PTT input changed */
+void sim_rail_ptt(int keyed)
+{
+	sim_rail.ptt_keyed = keyed;
+	sim_rail.ptt_at = sim_samples;
+	rail_log(keyed ? "ptt_key" : "ptt_unkey");
+}
+
+
+int sim_rail_receiving(void)
+{
+	return __atomic_load_n(&sim_rail.state, __ATOMIC_SEQ_CST) == RADIO_RX;
+}
+
+
+void sim_rail_report(void)
+{
+	printf("RAIL: %u receive starts, %u transmit starts, "
+		"%u configurations, %u offset retunes\n",
+		(unsigned)sim_rail.stats.rx_starts, (unsigned)sim_rail.stats.tx_starts,
+		(unsigned)sim_rail.stats.configs, (unsigned)sim_rail.stats.offsets);
+	printf("RAIL: receive FIFO overflowed by %u bytes, %u channel writes in transmit\n",
+		(unsigned)sim_rail.stats.rx_overflow_bytes,
+		(unsigned)sim_rail.stats.synth_writes_tx);
+	printf("RAIL: retune %.0f us (max %.0f), PTT to transmit %.0f us (max %.0f), "
+		"unkey to receive %.0f us (max %.0f)\n",
+		steps_us(sim_rail.stats.retune), steps_us(sim_rail.stats.retune_max),
+		steps_us(sim_rail.stats.ptt_tx), steps_us(sim_rail.stats.ptt_tx_max),
+		steps_us(sim_rail.stats.unkey_rx), steps_us(sim_rail.stats.unkey_rx_max));
+	if (sim_rail.log != NULL)
+		fflush(sim_rail.log);
+}
+
+
+/* Received sample from the file, which is read again from
+ * the start when it ends. Without a file, the input is weak noise. */
+static iq_in_t rx_sample(void)
+{
+	iq_in_t s;
+	if (sim_rail.iq_in != NULL) {
+		if (fread(&s, sizeof(s), 1, sim_rail.iq_in) == 1)
+			return s;
+		rewind(sim_rail.iq_in);
+		if (fread(&s, sizeof(s), 1, sim_rail.iq_in) == 1)
+			return s;
+	}
+	sim_rail.noise = sim_rail.noise * 1664525 + 1013904223;
+	s.i = (int16_t)(sim_rail.noise >> 16) >> 8;
+	s.q = (int16_t)sim_rail.noise >> 8;
+	return s;
+}
+
+
+/* ------------------
+ * RAIL functions
+ * ------------------ */
+
+RAIL_Handle_t RAIL_Init(RAIL_Config_t *railCfg, RAIL_InitCompleteCallbackPtr_t cb)
+{
+	sim_rail.config = railCfg;
+	sim_rail.state = RADIO_IDLE;
+	rail_log("init");
+	if (cb != NULL)
+		cb(railCfg);
+	return railCfg;
+}
+
+RAIL_Status_t RAIL_ConfigEvents(RAIL_Handle_t railHandle,
+	RAIL_Events_t mask, RAIL_Events_t events)
+{
+	(void)railHandle;
+	sim_rail.events = (sim_rail.events & ~mask) | (events & mask);
+	return RAIL_STATUS_NO_ERROR;
+}
+
+uint16_t RAIL_ConfigChannels(RAIL_Handle_t railHandle,
+	const RAIL_ChannelConfig_t *config, RAIL_RadioConfigChangedCallback_t cb)
+{
+	(void)railHandle;
+	(void)cb;
+	const RAIL_ChannelConfigEntry_t *e = &config->configs[0];
+	sim_rail.stats.configs++;
+	if (sim_rail.retune_at == 0)
+		sim_rail.retune_at = sim_samples;
+	rail_log("config_channels %lu %lu",
+		(unsigned long)e->baseFrequency, (unsigned long)e->channelSpacing);
+	rail_busy(sim_rail_model.config_channels_us);
+	return e->channelNumberEnd;
+}
+
+RAIL_Status_t RAIL_ConfigData(RAIL_Handle_t railHandle, const RAIL_DataConfig_t *dataConfig)
+{
+	(void)railHandle;
+	(void)dataConfig;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_ConfigTxPower(RAIL_Handle_t railHandle, const RAIL_TxPowerConfig_t *config)
+{
+	(void)railHandle;
+	(void)config;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_SetTxPower(RAIL_Handle_t railHandle, RAIL_TxPowerLevel_t powerLevel)
+{
+	(void)railHandle;
+	(void)powerLevel;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_SetFreqOffset(RAIL_Handle_t railHandle, RAIL_FrequencyOffset_t freqOffset)
+{
+	(void)railHandle;
+	sim_rail.stats.offsets++;
+	if (sim_rail.retune_at == 0)
+		sim_rail.retune_at = sim_samples;
+	rail_log("freq_offset %d", (int)freqOffset);
+	rail_busy(sim_rail_model.freq_offset_us);
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_ConfigCal(RAIL_Handle_t railHandle, RAIL_CalMask_t calEnable)
+{
+	(void)railHandle;
+	(void)calEnable;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+void RAIL_GetVersion(RAIL_Version_t *version, bool verbose)
+{
+	(void)verbose;
+	memset(version, 0, sizeof(*version));
+	version->major = 2;
+}
+
+RAIL_CalMask_t RAIL_GetPendingCal(RAIL_Handle_t railHandle)
+{
+	(void)railHandle;
+	return 0;
+}
+
+RAIL_Status_t RAIL_CalibrateTemp(RAIL_Handle_t railHandle)
+{
+	(void)railHandle;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_CalibrateIr(RAIL_Handle_t railHandle, uint32_t *imageRejection)
+{
+	(void)railHandle;
+	*imageRejection = 0;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_ApplyIrCalibration(RAIL_Handle_t railHandle, uint32_t imageRejection)
+{
+	(void)railHandle;
+	(void)imageRejection;
+	return RAIL_STATUS_NO_ERROR;
+}
+
+void RAIL_Idle(RAIL_Handle_t railHandle, RAIL_IdleMode_t mode, bool wait)
+{
+	(void)railHandle;
+	(void)mode;
+	if (__atomic_exchange_n(&sim_rail.state, RADIO_IDLE, __ATOMIC_SEQ_CST) == RADIO_IDLE)
+		return;
+	rail_log("idle");
+	if (wait)
+		rail_busy(sim_rail_model.idle_us);
+}
+
+RAIL_RadioState_t RAIL_GetRadioState(RAIL_Handle_t railHandle)
+{
+	(void)railHandle;
+	switch (__atomic_load_n(&sim_rail.state, __ATOMIC_SEQ_CST)) {
+	case RADIO_RX_WARMUP:
+	case RADIO_RX:
+		return RAIL_RF_STATE_RX_ACTIVE;
+	case RADIO_TX_WARMUP:
+	case RADIO_TX:
+		return RAIL_RF_STATE_TX_ACTIVE;
+	default:
+		return RAIL_RF_STATE_IDLE;
+	}
+}
+
+/* Start warming up for receive or transmit.
+ * RAIL writes the channel register when starting the radio. */
+static void radio_start(enum radio_state warmup, uint16_t channel, unsigned us)
+{
+	SYNTH_CHANNEL = channel;
+	sim_rail.ready_at = sim_samples + us_steps(us);
+	__atomic_store_n(&sim_rail.state, warmup, __ATOMIC_SEQ_CST);
+}
+
+RAIL_Status_t RAIL_StartRx(RAIL_Handle_t railHandle, uint16_t channel,
+	const RAIL_SchedulerInfo_t *schedulerInfo)
+{
+	(void)railHandle;
+	(void)schedulerInfo;
+	sim_rail.stats.rx_starts++;
+	rail_log("start_rx %u", (unsigned)channel);
+	radio_start(RADIO_RX_WARMUP, channel, sim_rail_model.rx_warmup_us);
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_StartTxStream(RAIL_Handle_t railHandle, uint16_t channel,
+	RAIL_StreamMode_t mode)
+{
+	(void)railHandle;
+	(void)mode;
+	sim_rail.stats.tx_starts++;
+	rail_log("start_tx_stream %u", (unsigned)channel);
+	radio_start(RADIO_TX_WARMUP, channel, sim_rail_model.tx_warmup_us);
+	return RAIL_STATUS_NO_ERROR;
+}
+
+RAIL_Status_t RAIL_StopTxStream(RAIL_Handle_t railHandle)
+{
+	(void)railHandle;
+	__atomic_store_n(&sim_rail.state, RADIO_IDLE, __ATOMIC_SEQ_CST);
+	rail_log("stop_tx_stream");
+	return RAIL_STATUS_NO_ERROR;
+}
+
+void RAIL_ResetFifo(RAIL_Handle_t railHandle, bool txFifo, bool rxFifo)
+{
+	(void)railHandle;
+	(void)txFifo;
+	if (rxFifo)
+		__atomic_store_n(&sim_rail.rx_fifo, 0, __ATOMIC_SEQ_CST);
+}
+
+uint16_t RAIL_SetRxFifoThreshold(RAIL_Handle_t railHandle, uint16_t rxThreshold)
+{
+	(void)railHandle;
+	if (rxThreshold > RX_FIFO_BYTES)
+		rxThreshold = RX_FIFO_BYTES;
+	sim_rail.rx_threshold = rxThreshold;
+	return rxThreshold;
+}
+
+uint16_t RAIL_ReadRxFifo(RAIL_Handle_t railHandle, uint8_t *dataPtr, uint16_t readLength)
+{
+	(void)railHandle;
+	unsigned n = readLength / sizeof(iq_in_t) * sizeof(iq_in_t);
+	unsigned have = __atomic_load_n(&sim_rail.rx_fifo, __ATOMIC_SEQ_CST);
+	do {
+		if (n > have)
+			n = have / sizeof(iq_in_t) * sizeof(iq_in_t);
+	} while (!__atomic_compare_exchange_n(&sim_rail.rx_fifo, &have, have - n,
+		0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+	// Like the FIFO threshold interrupt, the event comes again
+	// if the FIFO is still at the threshold after reading
+	__atomic_store_n(&sim_rail.rx_armed, 1, __ATOMIC_SEQ_CST);
+	unsigned i;
+	for (i = 0; i < n / sizeof(iq_in_t); i++) {
+		iq_in_t s = rx_sample();
+		memcpy(dataPtr + i * sizeof(s), &s, sizeof(s));
+	}
+	return n;
+}
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Included before every firmware source in the simulator build.
+ *
+ * The CMSIS core headers and emlib are used as they are, except for
+ * the parts written in ARM assembly and the peripheral bit set and
+ * clear aliases, which are replaced here by host equivalents.
+ * Peripheral registers themselves are plain memory mapped at their
+ * addresses by sim_main.c. */
+
+#ifndef SIM_TARGET_H_
+#define SIM_TARGET_H_
+
+// Host threads are named after tasks
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+
+/* ---------------------------------------------
+ * Replacement for cmsis_gcc.h
+ * --------------------------------------------- */
+#define __CMSIS_GCC_H
+
+#define __ASM                    __asm
+#define __INLINE                 inline
+#define __STATIC_INLINE          static inline
+#define __STATIC_FORCEINLINE     __attribute__((always_inline)) static inline
+#define __NO_RETURN              __attribute__((__noreturn__))
+#define __USED                   __attribute__((used))
+#define __WEAK                   __attribute__((weak))
+#define __PACKED                 __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT          struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION           union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)             __attribute__((aligned(x)))
+#define __RESTRICT               __restrict
+
+#define __UNALIGNED_UINT32(x)                (*(uint32_t *)(x))
+#define __UNALIGNED_UINT16_WRITE(addr, val)  (void)(*(uint16_t *)(void *)(addr) = (val))
+#define __UNALIGNED_UINT16_READ(addr)        (*(const uint16_t *)(const void *)(addr))
+#define __UNALIGNED_UINT32_WRITE(addr, val)  (void)(*(uint32_t *)(void *)(addr) = (val))
+#define __UNALIGNED_UINT32_READ(addr)        (*(const uint32_t *)(const void *)(addr))
+
+/* Interrupt masking is done by the FreeRTOS port, see
+ * freertos/portable/GCC/Posix/port.c */
+uint32_t ulPortSetInterruptMask(void);
+void vPortClearInterruptMask(uint32_t ulMask);
+
+__STATIC_FORCEINLINE void __enable_irq(void) { vPortClearInterruptMask(0); }
+__STATIC_FORCEINLINE void __disable_irq(void) { (void)ulPortSetInterruptMask(); }
+
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void)
+{
+	uint32_t m = ulPortSetInterruptMask();
+	vPortClearInterruptMask(m);
+	return m;
+}
+
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t m)
+{
+	if (m)
+		(void)ulPortSetInterruptMask();
+	else
+		vPortClearInterruptMask(0);
+}
+
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void) { return 0; }
+__STATIC_FORCEINLINE uint32_t __get_BASEPRI(void) { return 0; }
+__STATIC_FORCEINLINE void __set_BASEPRI(uint32_t v) { (void)v; }
+__STATIC_FORCEINLINE uint32_t __get_FPSCR(void) { return 0; }
+__STATIC_FORCEINLINE void __set_FPSCR(uint32_t v) { (void)v; }
+
+#define __NOP()  do {} while (0)
+#define __WFI()  do {} while (0)
+#define __WFE()  do {} while (0)
+#define __SEV()  do {} while (0)
+#define __BKPT(value) __builtin_trap()
+
+__STATIC_FORCEINLINE void __ISB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __DSB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __DMB(void) { __sync_synchronize(); }
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t v) { return __builtin_bswap32(v); }
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t v)
+{
+	return ((v & 0xFF00FF00u) >> 8) | ((v & 0x00FF00FFu) << 8);
+}
+__STATIC_FORCEINLINE int16_t __REVSH(int16_t v) { return (int16_t)__builtin_bswap16(v); }
+__STATIC_FORCEINLINE uint32_t __ROR(uint32_t v, uint32_t n)
+{
+	n %= 32;
+	return n ? (v >> n) | (v << (32 - n)) : v;
+}
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t v)
+{
+	uint32_t r = 0;
+	int i;
+	for (i = 0; i < 32; i++, v >>= 1)
+		r = (r << 1) | (v & 1);
+	return r;
+}
+__STATIC_FORCEINLINE uint8_t __CLZ(uint32_t v) { return v ? __builtin_clz(v) : 32; }
+
+__STATIC_FORCEINLINE int32_t __SSAT(int32_t v, uint32_t bits)
+{
+	int32_t max = (1 << (bits - 1)) - 1, min = -max - 1;
+	return v > max ? max : v < min ? min : v;
+}
+__STATIC_FORCEINLINE uint32_t __USAT(int32_t v, uint32_t bits)
+{
+	int32_t max = (1 << bits) - 1;
+	return v > max ? (uint32_t)max : v < 0 ? 0 : (uint32_t)v;
+}
+
+/* SIMD instructions are only referenced by inline functions in
+ * arm_math.h which the firmware does not use, so they are only
+ * declared to keep the compiler quiet. */
+uint32_t __QADD8(uint32_t, uint32_t);
+uint32_t __QSUB8(uint32_t, uint32_t);
+uint32_t __QADD16(uint32_t, uint32_t);
+uint32_t __QSUB16(uint32_t, uint32_t);
+uint32_t __SHADD16(uint32_t, uint32_t);
+uint32_t __SHSUB16(uint32_t, uint32_t);
+uint32_t __QASX(uint32_t, uint32_t);
+uint32_t __SHASX(uint32_t, uint32_t);
+uint32_t __QSAX(uint32_t, uint32_t);
+uint32_t __SHSAX(uint32_t, uint32_t);
+uint32_t __SMUSDX(uint32_t, uint32_t);
+uint32_t __SMUADX(uint32_t, uint32_t);
+uint32_t __SMUAD(uint32_t, uint32_t);
+uint32_t __SMUSD(uint32_t, uint32_t);
+uint32_t __SMLAD(uint32_t, uint32_t, uint32_t);
+uint32_t __SMLADX(uint32_t, uint32_t, uint32_t);
+uint32_t __SMLSDX(uint32_t, uint32_t, uint32_t);
+uint64_t __SMLALD(uint32_t, uint32_t, uint64_t);
+uint64_t __SMLALDX(uint32_t, uint32_t, uint64_t);
+uint32_t __SXTB16(uint32_t);
+int32_t __QADD(int32_t, int32_t);
+int32_t __QSUB(int32_t, int32_t);
+int32_t __SMMLA(int32_t, int32_t, int32_t);
+
+#define __PKHBT(ARG1, ARG2, ARG3) ((((uint32_t)(ARG1))          & 0x0000FFFFUL) | \
+                                   (((uint32_t)(ARG2) << (ARG3)) & 0xFFFF0000UL))
+#define __PKHTB(ARG1, ARG2, ARG3) ((((uint32_t)(ARG1))          & 0xFFFF0000UL) | \
+                                   (((uint32_t)(ARG2) >> (ARG3)) & 0x0000FFFFUL))
+
+/* ---------------------------------------------
+ * Replacement for em_bus.h
+ * ---------------------------------------------
+ * Registers are changed directly instead of
+ * through the bit band and bit set/clear aliases. */
+#define EM_BUS_H
+
+static inline void BUS_RamBitWrite(volatile uint32_t *addr, unsigned int bit, unsigned int val)
+{
+	*addr = (*addr & ~(1u << bit)) | ((val & 1u) << bit);
+}
+
+static inline unsigned int BUS_RamBitRead(volatile const uint32_t *addr, unsigned int bit)
+{
+	return (*addr >> bit) & 1u;
+}
+
+static inline void BUS_RegBitWrite(volatile uint32_t *addr, unsigned int bit, unsigned int val)
+{
+	*addr = (*addr & ~(1u << bit)) | ((val & 1u) << bit);
+}
+
+static inline unsigned int BUS_RegBitRead(volatile const uint32_t *addr, unsigned int bit)
+{
+	return (*addr >> bit) & 1u;
+}
+
+static inline void BUS_RegMaskedSet(volatile uint32_t *addr, uint32_t mask)
+{
+	*addr |= mask;
+}
+
+static inline void BUS_RegMaskedClear(volatile uint32_t *addr, uint32_t mask)
+{
+	*addr &= ~mask;
+}
+
+static inline void BUS_RegMaskedWrite(volatile uint32_t *addr, uint32_t mask, uint32_t val)
+{
+	*addr = (*addr & ~mask) | val;
+}
+
+static inline uint32_t BUS_RegMaskedRead(volatile const uint32_t *addr, uint32_t mask)
+{
+	return *addr & mask;
+}
+
+#endif /* SIM_TARGET_H_ */
@@ -28,6 +28,8 @@
 #include "em_adc.h"
 #include "em_gpio.h"
 #include "em_ldma.h"
+#include "em_pcnt.h"
+#include "em_prs.h"
 #include "em_timer.h"
 #include "em_usart.h"
 // [Library includes]$
@@ -45,8 +47,9 @@ extern void enter_DefaultMode_from_RESET(void) {
 	USART1_enter_DefaultMode_from_RESET();
 	LDMA_enter_DefaultMode_from_RESET();
 	TIMER0_enter_DefaultMode_from_RESET();
-	TIMER1_enter_DefaultMode_from_RESET();
 	PORTIO_enter_DefaultMode_from_RESET();
+	PRS_enter_DefaultMode_from_RESET();
+	PCNT0_enter_DefaultMode_from_RESET();
 	// [Config Calls]$
 
 }
@@ -133,7 +136,12 @@ extern void CMU_enter_DefaultMode_from_RESET(void) {
 	// [LE clocks enable]$
 
 	// $[LFACLK Setup]
-	/* LFACLK is disabled */
+	/* Enable LFRCO oscillator, and wait for it to be stable */
+	CMU_OscillatorEnable(cmuOsc_LFRCO, true, true);
+
+	/* Select LFRCO as clock source for LFACLK */
+	CMU_ClockSelectSet(cmuClock_LFA, cmuSelect_LFRCO);
+
 	// [LFACLK Setup]$
 	// $[LFBCLK Setup]
 	/* LFBCLK is disabled */
@@ -154,8 +162,14 @@ extern void CMU_enter_DefaultMode_from_RESET(void) {
 	/* Enable clock for TIMER0 */
 	CMU_ClockEnable(cmuClock_TIMER0, true);
 
-	/* Enable clock for TIMER1 */
-	CMU_ClockEnable(cmuClock_TIMER1, true);
+	/* Enable clock for PRS */
+	CMU_ClockEnable(cmuClock_PRS, true);
+
+	/* Enable clock for HF LE peripherals */
+	CMU_ClockEnable(cmuClock_HFLE, true);
+
+	/* Enable clock for PCNT0 */
+	CMU_ClockEnable(cmuClock_PCNT0, true);
 
 	/* Enable clock for USART0 */
 	CMU_ClockEnable(cmuClock_USART0, true);
@@ -600,119 +614,6 @@ extern void TIMER0_enter_DefaultMode_from_RESET(void) {
 
 }
 
-//================================================================================
-// TIMER1_enter_DefaultMode_from_RESET
-//================================================================================
-extern void TIMER1_enter_DefaultMode_from_RESET(void) {
-
-	// $[TIMER1 I/O setup]
-	/* Set up CC0 (Encoder input) */
-	TIMER1->ROUTELOC0 = (TIMER1->ROUTELOC0 & (~_TIMER_ROUTELOC0_CC0LOC_MASK))
-			| ENC1_TIM1_CC0;
-	TIMER1->ROUTEPEN = TIMER1->ROUTEPEN | TIMER_ROUTEPEN_CC0PEN;
-	/* Set up CC1 (Encoder input) */
-	TIMER1->ROUTELOC0 = (TIMER1->ROUTELOC0 & (~_TIMER_ROUTELOC0_CC1LOC_MASK))
-			| ENC2_TIM1_CC1;
-	TIMER1->ROUTEPEN = TIMER1->ROUTEPEN | TIMER_ROUTEPEN_CC1PEN;
-	/* Set up CC2 */
-	TIMER1->ROUTELOC0 = (TIMER1->ROUTELOC0 & (~_TIMER_ROUTELOC0_CC2LOC_MASK))
-			| TIMER_ROUTELOC0_CC2LOC_LOC0;
-	TIMER1->ROUTEPEN = TIMER1->ROUTEPEN & (~TIMER_ROUTEPEN_CC2PEN);
-	/* Set up CC3 */
-	TIMER1->ROUTELOC0 = (TIMER1->ROUTELOC0 & (~_TIMER_ROUTELOC0_CC3LOC_MASK))
-			| TIMER_ROUTELOC0_CC3LOC_LOC0;
-	TIMER1->ROUTEPEN = TIMER1->ROUTEPEN & (~TIMER_ROUTEPEN_CC3PEN);
-	// [TIMER1 I/O setup]$
-
-	// $[TIMER1 initialization]
-	TIMER_Init_TypeDef init = TIMER_INIT_DEFAULT;
-
-	init.enable = 1;
-	init.debugRun = 0;
-	init.dmaClrAct = 0;
-	init.sync = 0;
-	init.clkSel = timerClkSelHFPerClk;
-	init.prescale = timerPrescale1;
-	init.fallAction = timerInputActionNone;
-	init.riseAction = timerInputActionNone;
-	init.mode = timerModeQDec;
-	init.quadModeX4 = 1;
-	init.oneShot = 0;
-	init.count2x = 0;
-	init.ati = 0;
-	TIMER_Init(TIMER1, &init);
-	// [TIMER1 initialization]$
-
-	// $[TIMER1 CC0 init]
-	TIMER_InitCC_TypeDef initCC0 = TIMER_INITCC_DEFAULT;
-
-	initCC0.prsInput = false;
-	initCC0.prsSel = timerPRSSELCh0;
-	initCC0.edge = timerEdgeRising;
-	initCC0.mode = timerCCModeCapture;
-	initCC0.eventCtrl = timerEventEveryEdge;
-	initCC0.filter = 1;
-	initCC0.cofoa = timerOutputActionNone;
-	initCC0.cufoa = timerOutputActionNone;
-	initCC0.cmoa = timerOutputActionNone;
-	initCC0.coist = 0;
-	initCC0.outInvert = 0;
-	TIMER_InitCC(TIMER1, 0, &initCC0);
-	// [TIMER1 CC0 init]$
-
-	// $[TIMER1 CC1 init]
-	TIMER_InitCC_TypeDef initCC1 = TIMER_INITCC_DEFAULT;
-
-	initCC1.prsInput = false;
-	initCC1.prsSel = timerPRSSELCh0;
-	initCC1.edge = timerEdgeRising;
-	initCC1.mode = timerCCModeCapture;
-	initCC1.eventCtrl = timerEventEveryEdge;
-	initCC1.filter = 1;
-	initCC1.cofoa = timerOutputActionNone;
-	initCC1.cufoa = timerOutputActionNone;
-	initCC1.cmoa = timerOutputActionNone;
-	initCC1.coist = 0;
-	initCC1.outInvert = 0;
-	TIMER_InitCC(TIMER1, 1, &initCC1);
-	// [TIMER1 CC1 init]$
-
-	// $[TIMER1 CC2 init]
-	TIMER_InitCC_TypeDef initCC2 = TIMER_INITCC_DEFAULT;
-
-	initCC2.prsInput = false;
-	initCC2.prsSel = timerPRSSELCh0;
-	initCC2.edge = timerEdgeRising;
-	initCC2.mode = timerCCModeOff;
-	initCC2.eventCtrl = timerEventEveryEdge;
-	initCC2.filter = 0;
-	initCC2.cofoa = timerOutputActionNone;
-	initCC2.cufoa = timerOutputActionNone;
-	initCC2.cmoa = timerOutputActionNone;
-	initCC2.coist = 0;
-	initCC2.outInvert = 0;
-	TIMER_InitCC(TIMER1, 2, &initCC2);
-	// [TIMER1 CC2 init]$
-
-	// $[TIMER1 CC3 init]
-	TIMER_InitCC_TypeDef initCC3 = TIMER_INITCC_DEFAULT;
-
-	initCC3.prsInput = false;
-	initCC3.prsSel = timerPRSSELCh0;
-	initCC3.edge = timerEdgeRising;
-	initCC3.mode = timerCCModeOff;
-	initCC3.eventCtrl = timerEventEveryEdge;
-	initCC3.filter = 0;
-	initCC3.cofoa = timerOutputActionNone;
-	initCC3.cufoa = timerOutputActionNone;
-	initCC3.cmoa = timerOutputActionNone;
-	initCC3.coist = 0;
-	initCC3.outInvert = 0;
-	TIMER_InitCC(TIMER1, 3, &initCC3);
-	// [TIMER1 CC3 init]$
-
-}
-
 //================================================================================
 // LETIMER0_enter_DefaultMode_from_RESET
 //================================================================================
@@ -751,9 +652,32 @@ extern void CRYOTIMER_enter_DefaultMode_from_RESET(void) {
 extern void PCNT0_enter_DefaultMode_from_RESET(void) {
 
 	// $[PCNT0 I/O setup]
+	/* Encoder inputs come through PRS */
+	PCNT_PRSInputEnable(PCNT0, pcntPRSInputS0, true);
+	PCNT_PRSInputEnable(PCNT0, pcntPRSInputS1, true);
 	// [PCNT0 I/O setup]$
 
 	// $[PCNT0 initialization]
+	PCNT_Init_TypeDef init = PCNT_INIT_DEFAULT;
+
+	init.mode = pcntModeOvsQuad4;
+	init.counter = 0;
+	init.top = 0xFFFF;
+	init.negEdge = 0;
+	init.filter = 1;
+	init.cntEvent = pcntCntEventBoth;
+	/* The TIMER quadrature decoder counts up when CC0 leads CC1,
+	 * and the PCNT quadrature decoder counts up when S0IN leads S1IN.
+	 * ENC1 was on TIMER1 CC0, so it goes to S0 for the same direction. */
+	init.s0PRS = ENC1_PRS_CH;
+	init.s1PRS = ENC2_PRS_CH;
+	PCNT_Init(PCNT0, &init);
+
+#if defined(PCNT_OVSCFG_FILTLEN_DEFAULT)
+	PCNT_Filter_TypeDef filter = PCNT_FILTER_DEFAULT;
+	filter.flutterrm = true;
+	PCNT_FilterConfiguration(PCNT0, &filter, true);
+#endif
 	// [PCNT0 initialization]$
 
 }
@@ -764,6 +688,17 @@ extern void PCNT0_enter_DefaultMode_from_RESET(void) {
 extern void PRS_enter_DefaultMode_from_RESET(void) {
 
 	// $[PRS initialization]
+	/* Encoder pins to PCNT0.
+	 * GPIO signals to PRS come through external interrupt lines,
+	 * so select the pins for the lines without enabling interrupts. */
+	GPIO_ExtIntConfig(ENC1_PORT, ENC1_PIN, ENC1_PIN, false, false, false);
+	GPIO_ExtIntConfig(ENC2_PORT, ENC2_PIN, ENC2_PIN, false, false, false);
+	PRS_SourceAsyncSignalSet(ENC1_PRS_CH,
+		ENC1_PIN < 8 ? PRS_CH_CTRL_SOURCESEL_GPIOL : PRS_CH_CTRL_SOURCESEL_GPIOH,
+		(ENC1_PIN & 7) << _PRS_CH_CTRL_SIGSEL_SHIFT);
+	PRS_SourceAsyncSignalSet(ENC2_PRS_CH,
+		ENC2_PIN < 8 ? PRS_CH_CTRL_SOURCESEL_GPIOL : PRS_CH_CTRL_SOURCESEL_GPIOH,
+		(ENC2_PIN & 7) << _PRS_CH_CTRL_SIGSEL_SHIFT);
 	// [PRS initialization]$
 
 }
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "em_device.h"
+
+#include "bootprof.h"
+#include "diagnostics.h"
+
+#include <stdio.h>
+
+static const char *const boot_milestone_names[BOOT_MILESTONES] = {
+	"CHIP_Init",
+	"Clocks",
+	"Scheduler",
+	"RAIL init",
+	"Display ready",
+	"First RX block",
+	"First audio",
+};
+
+struct boot_profile {
+	// Bit mask of milestones reached
+	uint32_t reached;
+	char reported;
+	// Cycle counter value at the previous milestone and time
+	// in microseconds accumulated until then. The core clock
+	// frequency changes during boot, so time is accumulated
+	// using the frequency at each milestone.
+	uint32_t prev_cycles, prev_us;
+	uint32_t us[BOOT_MILESTONES];
+};
+static struct boot_profile boot;
+
+
+void boot_profile_start(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+void boot_milestone(enum boot_milestone m)
+{
+	if (boot.reached & (1UL << m))
+		return;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t cycles = DWT->CYCCNT;
+	uint32_t mhz = SystemCoreClockGet() / 1000000;
+	boot.prev_us += (cycles - boot.prev_cycles) / mhz;
+	boot.prev_cycles = cycles;
+	boot.us[m] = boot.prev_us;
+	boot.reached |= 1UL << m;
+	__set_PRIMASK(primask);
+	if (m == BOOT_FIRST_AUDIO)
+		diag.startup_audio_ms = boot.prev_us / 1000;
+}
+
+
+void boot_profile_report(void)
+{
+	if (boot.reported || boot.reached != (1UL << BOOT_MILESTONES) - 1)
+		return;
+	boot.reported = 1;
+	unsigned i;
+	for (i = 0; i < BOOT_MILESTONES; i++)
+		printf("Boot %-15s %7lu us\n", boot_milestone_names[i], (unsigned long)boot.us[i]);
+}
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Signal capture written to RTT up-buffer 2.
+ * The taps are in dsp.c and run in the fast DSP task,
+ * which is the only writer, so no locking is needed here. */
+
+#if CAPTURE
+
+#include "em_device.h"
+
+// rig
+#include "capture.h"
+#include "debugprint.h"
+#include "diagnostics.h"
+
+#include <math.h>
+#include <string.h>
+
+struct capture capture = { .tap = CAPTURE_OFF, .codec = CAPTURE_BFP8 };
+
+static struct {
+	struct capture_header h;
+	uint8_t data[CAPTURE_MAXLEN * 2];
+} block;
+static int16_t values[CAPTURE_MAXLEN];
+static uint16_t seq;
+
+
+/* G.711 mu-law, as in the reference encoder
+ * but finding the segment by counting leading zeros. */
+static uint8_t mulaw_encode(int16_t x)
+{
+	const int bias = 0x84, clip = 32635;
+	int v = x, sign = 0;
+	if (v < 0) {
+		v = -v;
+		sign = 0x80;
+	}
+	if (v > clip)
+		v = clip;
+	v += bias;
+	int segment = 31 - __builtin_clz(v) - 7;
+	int mantissa = (v >> (segment + 3)) & 0x0F;
+	return ~(sign | (segment << 4) | mantissa);
+}
+
+
+/* Encode values[0..n) with the selected codec and write the block. */
+static void capture_send(enum capture_tap tap, unsigned n, int exponent)
+{
+	unsigned codec = capture.codec, len = n, i;
+	switch (codec) {
+	case CAPTURE_BFP8: {
+		/* Shift so that the largest value fits in 8 bits.
+		 * ~x is used for negative values so that -128 still fits. */
+		unsigned bits = 0, shift = 0;
+		for (i = 0; i < n; i++)
+			bits |= values[i] < 0 ? ~values[i] : values[i];
+		if (bits > 127)
+			shift = 32 - __builtin_clz(bits) - 7;
+		for (i = 0; i < n; i++)
+			block.data[i] = (uint8_t)(values[i] >> shift);
+		exponent += shift;
+		break;
+	}
+	case CAPTURE_MULAW:
+		for (i = 0; i < n; i++)
+			block.data[i] = mulaw_encode(values[i]);
+		break;
+	default:
+		codec = CAPTURE_RAW16;
+		len = n * 2;
+		memcpy(block.data, values, len);
+		break;
+	}
+	block.h = (struct capture_header){
+		.magic = CAPTURE_MAGIC,
+		.tap = tap,
+		.codec = codec,
+		.exponent = exponent,
+		.seq = seq++,
+		.n = n,
+		.cycles = DWT->CYCCNT,
+	};
+	if (!rtt_write(RTT_CAPTURE, &block, sizeof(block.h) + len))
+		++diag.capture_dropped;
+}
+
+
+void capture_iq_in(const iq_in_t *in, unsigned len)
+{
+	if (len > CAPTURE_MAXLEN / 2)
+		len = CAPTURE_MAXLEN / 2;
+	unsigned i;
+	for (i = 0; i < len; i++) {
+		values[2*i]   = in[i].i;
+		values[2*i+1] = in[i].q;
+	}
+	capture_send(CAPTURE_RX_IQ, len * 2, 0);
+}
+
+
+void capture_iq_float(const iq_float_t *in, unsigned len)
+{
+	if (len > CAPTURE_MAXLEN / 2)
+		len = CAPTURE_MAXLEN / 2;
+	capture_float(CAPTURE_RX_MIXED, &in[0].i, len * 2);
+}
+
+
+/* Floats are scaled by a power of two so that
+ * the largest one uses the full 16 bits. */
+void capture_float(enum capture_tap tap, const float *in, unsigned len)
+{
+	if (len > CAPTURE_MAXLEN)
+		len = CAPTURE_MAXLEN;
+	float max = 0.0f;
+	unsigned i;
+	for (i = 0; i < len; i++) {
+		float a = fabsf(in[i]);
+		if (a > max)
+			max = a;
+	}
+	int exponent = 0;
+	if (max > 0.0f) {
+		frexpf(max, &exponent);
+		// max < 2^exponent, so max / 2^(exponent-15) < 32768
+		exponent -= 15;
+		if (exponent < -120)
+			exponent = -120;
+	}
+	float scale = ldexpf(1.0f, -exponent);
+	for (i = 0; i < len; i++)
+		values[i] = (int16_t)(in[i] * scale);
+	capture_send(tap, len, exponent);
+}
+
+
+void capture_u16(enum capture_tap tap, const uint16_t *in, unsigned len, uint16_t mid)
+{
+	if (len > CAPTURE_MAXLEN)
+		len = CAPTURE_MAXLEN;
+	unsigned i;
+	for (i = 0; i < len; i++)
+		values[i] = (int16_t)(in[i] - mid);
+	capture_send(tap, len, 0);
+}
+
+#endif
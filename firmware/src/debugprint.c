@@ -3,70 +3,169 @@
 #include <string.h>
 #include <stdint.h>
 
+// FreeRTOS
+#include "FreeRTOS.h"
+
+#include "debugprint.h"
+#include "diagnostics.h"
+
 /* The debug buffer is somewhat compatible with SEGGER RTT,
  * so it can be read with at least some RTT readers.
  * Not tested yet with Segger software.
+ *
+ * Each channel is a ring buffer written by the MCU and read
+ * by the debugger. The debugger only moves rdOff, and the MCU only
+ * moves wrOff after the data is in place, so the debugger
+ * can read at any time without locking.
+ * Writers on the MCU side can be tasks or interrupts, so they
+ * are serialized by masking interrupts which may call FreeRTOS.
+ * Higher priority interrupts keep running, but must not write.
  */
 
-#define DEBUGBUFFER_SIZE 0x200
+// Buffer sizes. These must be powers of two, or 0 to disable a channel.
+#define PRINTBUFFER_SIZE 0x200
+#if TRACE
+#define TRACEBUFFER_SIZE 0x800
+#else
+#define TRACEBUFFER_SIZE 0
+#endif
+#if CAPTURE
+#define CAPTUREBUFFER_SIZE 0x1000
+#else
+#define CAPTUREBUFFER_SIZE 0
+#endif
+#if RECORD
+#define RECORDBUFFER_SIZE 0x1000
+#else
+#define RECORDBUFFER_SIZE 0
+#endif
 #define DOWNBUFFER_SIZE 4
 
+#if (PRINTBUFFER_SIZE & (PRINTBUFFER_SIZE - 1)) \
+	|| (TRACEBUFFER_SIZE & (TRACEBUFFER_SIZE - 1)) \
+	|| (CAPTUREBUFFER_SIZE & (CAPTUREBUFFER_SIZE - 1)) \
+	|| (RECORDBUFFER_SIZE & (RECORDBUFFER_SIZE - 1))
+#error "RTT buffer sizes must be powers of two"
+#endif
+
+struct rtt_buffer {
+	const char *sName;
+	char *pBuffer;
+	uint32_t size;
+	volatile uint32_t wrOff, rdOff;
+	uint32_t Flags;
+};
+
 struct debugbuffer {
 	char acID[16];
 	uint32_t MaxNumUpBuffers, MaxNumDownBuffers;
 	// Up buffer info (MCU to debugger)
-	char *sName, *pBuffer;
-	uint32_t size, wrOff;
-	volatile uint32_t rdOff;
-	uint32_t Flags;
+	struct rtt_buffer up[RTT_CHANNELS];
 	// Dummy down buffer info
 	// because some RTT readers do not work without one
-	char *sNameUp, *pBufferUp;
-	uint32_t sizeUp, wrOffUp;
-	volatile uint32_t rdOffUp;
-	uint32_t FlagsUp;
-	// Buffers
-	char buffer[DEBUGBUFFER_SIZE];
-	char bufferUp[DOWNBUFFER_SIZE];
+	struct rtt_buffer down;
 };
 
 /* Cortex-Debug RTT reader looks for a symbol named _SEGGER_RTT
  * so use that name for the struct. */
 struct debugbuffer _SEGGER_RTT;
 
+static char printbuffer[PRINTBUFFER_SIZE];
+#if TRACEBUFFER_SIZE
+static char tracebuffer[TRACEBUFFER_SIZE];
+#endif
+#if CAPTUREBUFFER_SIZE
+static char capturebuffer[CAPTUREBUFFER_SIZE];
+#endif
+#if RECORDBUFFER_SIZE
+static char recordbuffer[RECORDBUFFER_SIZE];
+#endif
+static char downbuffer[DOWNBUFFER_SIZE];
+
+static void debug_init_channel(struct rtt_buffer *b, const char *name, char *buf, unsigned size)
+{
+	b->sName = name;
+	b->pBuffer = buf;
+	b->size = size;
+}
+
 void debug_init(void)
 {
 	struct debugbuffer *b = &_SEGGER_RTT;
-	memset(b, 0, (void*)b->buffer - (void*)b);
-	b->sName = "Debug print";
-	b->pBuffer = b->buffer;
-	b->size = DEBUGBUFFER_SIZE;
-	b->sNameUp = b->sName;
-	b->pBufferUp = b->bufferUp;
-	b->sizeUp = DOWNBUFFER_SIZE;
-	b->MaxNumUpBuffers = 1;
+	memset(b, 0, sizeof(*b));
+	debug_init_channel(&b->up[RTT_PRINT], "Debug print", printbuffer, PRINTBUFFER_SIZE);
+#if TRACEBUFFER_SIZE
+	debug_init_channel(&b->up[RTT_TRACE], "Trace", tracebuffer, TRACEBUFFER_SIZE);
+#else
+	debug_init_channel(&b->up[RTT_TRACE], "Trace", NULL, 0);
+#endif
+#if CAPTUREBUFFER_SIZE
+	debug_init_channel(&b->up[RTT_CAPTURE], "Capture", capturebuffer, CAPTUREBUFFER_SIZE);
+#else
+	debug_init_channel(&b->up[RTT_CAPTURE], "Capture", NULL, 0);
+#endif
+#if RECORDBUFFER_SIZE
+	debug_init_channel(&b->up[RTT_RECORD], "Record", recordbuffer, RECORDBUFFER_SIZE);
+#else
+	debug_init_channel(&b->up[RTT_RECORD], "Record", NULL, 0);
+#endif
+	debug_init_channel(&b->down, "Debug print", downbuffer, DOWNBUFFER_SIZE);
+	b->MaxNumUpBuffers = RTT_CHANNELS;
 	b->MaxNumDownBuffers = 1;
+	// Write the ID last, so a debugger searching for it
+	// does not find a half initialized control block.
 	strcpy(b->acID, " EGGER RTT");
+	__DMB();
 	b->acID[0] = 'S';
 }
 
+/* Copy data to a channel.
+ * If partial is 1, write as much as fits,
+ * otherwise write everything or nothing.
+ * Returns the number of bytes written. */
+static unsigned rtt_put(enum rtt_channel ch, const void *data, unsigned len, int partial)
+{
+	struct rtt_buffer *b = &_SEGGER_RTT.up[ch];
+	UBaseType_t s = portSET_INTERRUPT_MASK_FROM_ISR();
+	unsigned size = b->size, wr = b->wrOff;
+	unsigned space = size ? (b->rdOff - wr - 1) & (size - 1) : 0;
+	unsigned n = len;
+	if (n > space)
+		n = partial ? space : 0;
+	if (n > 0) {
+		unsigned first = size - wr;
+		if (first > n)
+			first = n;
+		memcpy(b->pBuffer + wr, data, first);
+		memcpy(b->pBuffer, (const char*)data + first, n - first);
+		// Make sure the data is in memory before the debugger sees it
+		__DMB();
+		b->wrOff = (wr + n) & (size - 1);
+	}
+	diag.rtt_dropped[ch] += len - n;
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(s);
+	return n;
+}
+
+int rtt_write(enum rtt_channel ch, const void *data, unsigned len)
+{
+	return rtt_put(ch, data, len, 0) == len;
+}
+
+unsigned rtt_space(enum rtt_channel ch)
+{
+	struct rtt_buffer *b = &_SEGGER_RTT.up[ch];
+	unsigned size = b->size;
+	return size ? (b->rdOff - b->wrOff - 1) & (size - 1) : 0;
+}
+
+/* Text does not need to be written whole, so print as much as fits.
+ * Old text is not overwritten, so the beginning of the log
+ * stays until a debugger reads it. */
 int _write(int file, const char *ptr, int len)
 {
 	if (!(file == 1 || file == 2))
 		return -1;
-	struct debugbuffer *b = &_SEGGER_RTT;
-	unsigned pos = b->wrOff;
-	int i;
-
-	if (pos >= DEBUGBUFFER_SIZE)
-		pos = 0;
-
-	for (i = 0; i < len; i++) {
-		b->buffer[pos] = ptr[i];
-		++pos;
-		if(pos >= DEBUGBUFFER_SIZE)
-			pos = 0;
-	}
-	b->wrOff = pos;
+	rtt_put(RTT_PRINT, ptr, len, 1);
 	return len;
 }
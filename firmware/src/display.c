@@ -8,10 +8,13 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include "em_usart.h"
 #include "em_gpio.h"
 #include "em_ldma.h"
 #include "em_timer.h"
+#include "em_bus.h"
 #include "InitDevice.h"
 
 // FreeRTOS
@@ -22,47 +25,45 @@
 
 // rig
 #include "ui_parameters.h"
+#include "display.h"
+#include "trace.h"
+#include "diagnostics.h"
 
+// Channel sending pixel data, paced by USART1 TX buffer level
 #define DISPLAY_DMA_CH 0
-static int display_initialized = 0, display_doing_dma = 0;
+// Channel sending window commands, paced by USART1 becoming empty
+#define DISPLAY_CMD_DMA_CH 1
+static int display_initialized = 0, display_busy = 0;
 
 /*
  * The display has a pin which selects whether an SPI transfer is going
  * to be a command or a data byte. This is controlled by a GPIO output.
  * writecommand() and writedata() set the state of that pin and
  * busy-wait until the next transfer can be done, so that the GPIO is
- * set at the right moment.
+ * set at the right moment. These are only used during initialization.
  *
- * Busy-waiting during SPI transfers seems kind of ugly, but a typical
- * command-data cycle takes just a few tens of CPU clock cycles.
- * Thus, there's not much time to do a context switch to something
- * else during a command transfer.
- * For short commands, I guess it's most efficient to just busy wait...
+ * After initialization, everything is sent by DMA. Each window is
+ * a "job" made of a chain of LDMA descriptors on the command channel.
+ * The command channel is paced by the USART becoming completely empty,
+ * so a dummy transfer in the chain waits for the previous byte to be
+ * shifted out before the DC pin is toggled by a WRITE descriptor
+ * through the GPIO bit set/clear alias. Once the window commands
+ * have been sent, the last descriptor starts the pixel data channel
+ * by writing to LDMA->LINKLOAD, and the data channel interrupts
+ * when the whole job is done.
  *
- * Pixel data is transferred using DMA and the task is blocked during
- * the transfer, allowing a context switch to another task.
+ * One job can be in flight at a time. Starting a new job waits for
+ * the previous one to finish, so a task can render the next window
+ * into the other render buffer while the previous one is being sent.
+ * Since the rendering and the SPI transfer take about the same time,
+ * this almost doubles the redraw rate compared to waiting for each
+ * transfer to finish before starting to render the next one.
  */
 
-void display_start(void)
-{
-	while (!(USART1->STATUS & USART_STATUS_TXC));
-	GPIO_PinOutSet(TFT_CS_PORT, TFT_CS_PIN);
-	GPIO_PinOutSet(TFT_DC_PORT, TFT_DC_PIN);
-	GPIO_PinOutClear(TFT_CS_PORT, TFT_CS_PIN);
-}
-
-void display_end(void)
-{
-	while (!(USART1->STATUS & USART_STATUS_TXC));
-	GPIO_PinOutSet(TFT_CS_PORT, TFT_CS_PIN);
-}
-
 static void writedata(uint8_t d)
 {
-	//display_start();
 	GPIO_PinOutSet(TFT_DC_PORT, TFT_DC_PIN);
 	USART_SpiTransfer(USART1, d);
-	//display_end();
 }
 
 static void writecommand(uint8_t d)
@@ -71,64 +72,162 @@ static void writecommand(uint8_t d)
 	GPIO_PinOutClear(TFT_DC_PORT, TFT_DC_PIN);
 	GPIO_PinOutClear(TFT_CS_PORT, TFT_CS_PIN);
 	USART_SpiTransfer(USART1, d);
-	//GPIO_PinOutSet(TFT_CS_PORT, TFT_CS_PIN);
-}
-
-void display_pixel(uint8_t r, uint8_t g, uint8_t b)
-{
-	USART_Tx(USART1, r);
-	USART_Tx(USART1, g);
-	USART_Tx(USART1, b);
 }
 
 static TaskHandle_t myhandle;
 
 void LDMA_IRQHandler(void)
 {
+	diag_isr_enter();
+	TRACE_ISR_ENTER(TRACE_ISR_DISPLAY_DMA);
 	uint32_t pending = LDMA_IntGetEnabled();
-	if(pending & (1<<DISPLAY_DMA_CH)) {
-		LDMA->IFC = 1<<DISPLAY_DMA_CH;
+	const uint32_t chmask = (1<<DISPLAY_DMA_CH) | (1<<DISPLAY_CMD_DMA_CH);
+	if(pending & chmask) {
+		LDMA->IFC = pending & chmask;
 		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 		vTaskNotifyGiveFromISR(myhandle, &xHigherPriorityTaskWoken);
+		TRACE_ISR_EXIT(TRACE_ISR_DISPLAY_DMA);
+		diag_isr_exit();
 		portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+		return;
 	}
+	TRACE_ISR_EXIT(TRACE_ISR_DISPLAY_DMA);
+	diag_isr_exit();
+}
+
+
+// Longest chain is a window: 3 commands of 6 descriptors
+#define DISPLAY_JOB_DESC 18
+#define DISPLAY_JOB_BYTES 16
+
+/* Descriptors and command bytes of the job being sent.
+ * These must stay untouched until the job is done. */
+struct display_job {
+	unsigned ndesc, nbytes;
+	LDMA_Descriptor_t desc[DISPLAY_JOB_DESC];
+	LDMA_Descriptor_t data;
+	uint8_t bytes[DISPLAY_JOB_BYTES];
+	uint8_t dummy;
+};
+static struct display_job job;
+
+static uint8_t display_bufs[DISPLAY_RENDER_BUFS][DISPLAY_BUF_SIZE];
+static unsigned display_buf_next;
+
+static void job_append(LDMA_Descriptor_t d)
+{
+	job.desc[job.ndesc++] = d;
+}
+
+// Wait until the previous byte has been shifted out
+static void job_wait_empty(void)
+{
+	LDMA_Descriptor_t d = LDMA_DESCRIPTOR_LINKREL_M2M_BYTE(&job.dummy, &job.dummy, 1, 1);
+	d.xfer.structReq = 0;
+	job_append(d);
 }
 
-void display_transfer(const uint8_t *dmadata, int dmalen)
+// Set the state of the DC pin: 0 for command, 1 for data
+static void job_dc(int data)
 {
+	uint32_t dout = (uint32_t)&GPIO->P[TFT_DC_PORT].DOUT - PER_MEM_BASE;
+	dout += data ? PER_BITSET_MEM_BASE : PER_BITCLR_MEM_BASE;
+	LDMA_Descriptor_t d = LDMA_DESCRIPTOR_LINKREL_WRITE(1 << TFT_DC_PIN, dout, 1);
+	job_append(d);
+}
+
+static void job_bytes(const uint8_t *b, unsigned n)
+{
+	uint8_t *p = &job.bytes[job.nbytes];
+	memcpy(p, b, n);
+	job.nbytes += n;
+	LDMA_Descriptor_t d = LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(p, &USART1->TXDATA, n, 1);
+	d.xfer.doneIfs = 0;
+	job_append(d);
+}
+
+static void job_command(uint8_t cmd, const uint8_t *data, unsigned n)
+{
+	job_wait_empty();
+	job_dc(0);
+	job_bytes(&cmd, 1);
+	job_wait_empty();
+	job_dc(1);
+	if (n > 0)
+		job_bytes(data, n);
+}
+
+/* Start the job in the descriptor list.
+ * If data is not NULL, the pixel data channel is started
+ * after the commands and it interrupts when done.
+ * Otherwise, the last command descriptor interrupts. */
+static void job_start(const uint8_t *data, int len)
+{
+	if (data != NULL) {
+		LDMA_Descriptor_t d = LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(data, &USART1->TXDATA, len);
+		job.data = d;
+		LDMA->CH[DISPLAY_DMA_CH].REQSEL = ldmaPeripheralSignal_USART1_TXBL;
+		LDMA->CH[DISPLAY_DMA_CH].LOOP = 0;
+		LDMA->CH[DISPLAY_DMA_CH].CFG = 0;
+		LDMA->CH[DISPLAY_DMA_CH].LINK = (uint32_t)&job.data & _LDMA_CH_LINK_LINKADDR_MASK;
+		LDMA->IFC = 1<<DISPLAY_DMA_CH;
+		LDMA->IEN |= 1<<DISPLAY_DMA_CH;
+		BUS_RegMaskedClear(&LDMA->CHDONE, 1<<DISPLAY_DMA_CH);
+
+		LDMA_Descriptor_t l = LDMA_DESCRIPTOR_LINKREL_WRITE(1<<DISPLAY_DMA_CH, &LDMA->LINKLOAD, 1);
+		job_append(l);
+	} else {
+		job.desc[job.ndesc-1].xfer.doneIfs = 1;
+	}
+	job.desc[job.ndesc-1].xfer.link = 0;
+
 	LDMA_TransferCfg_t tr =
-			LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_USART1_TXBL);
-	LDMA_Descriptor_t desc =
-			LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(dmadata, &USART1->TXDATA, dmalen);
-	//LDMA_IntEnable(1<<DISPLAY_DMA_CH);
-	display_doing_dma = 1;
-	myhandle = xTaskGetCurrentTaskHandle();
-	LDMA_StartTransfer(DISPLAY_DMA_CH, &tr, &desc);
-	ulTaskNotifyTake(pdFALSE, 100);
+			LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_USART1_TXEMPTY);
+	display_busy = 1;
+	LDMA_StartTransfer(DISPLAY_CMD_DMA_CH, &tr, &job.desc[0]);
+}
+
+/* Wait for the job in flight to finish. */
+void display_sync(void)
+{
+	if (!display_busy)
+		return;
+	if (ulTaskNotifyTake(pdTRUE, 100) == 0) {
+		printf("Display DMA timeout\n");
+		LDMA_StopTransfer(DISPLAY_CMD_DMA_CH);
+		LDMA_StopTransfer(DISPLAY_DMA_CH);
+	}
+	display_busy = 0;
+	job.ndesc = 0;
+	job.nbytes = 0;
 }
 
-void display_area(int x1,int y1,int x2,int y2)
+/* Get a render buffer which is not being sent.
+ * The buffer stays free until it is passed to display_window. */
+uint8_t *display_buffer(void)
 {
-	writecommand(0x2A); // column address set
-	writedata(0);
-	writedata(x1);
-	writedata(0);
-	writedata(x2);
-	writecommand(0x2B); // row address set
-	writedata(0);
-	writedata(y1);
-	writedata(0);
-	writedata(y2);
-	writecommand(0x2C); // memory write
+	return display_bufs[display_buf_next];
+}
+
+/* Send pixel data to a window on the display.
+ * The data is sent in the background and must not change
+ * until the next call to display_window, display_scroll
+ * or display_sync. */
+void display_window(int x1, int y1, int x2, int y2, const uint8_t *data, int len)
+{
+	display_sync();
+	const uint8_t col[4] = { 0, x1, 0, x2 }, row[4] = { 0, y1, 0, y2 };
+	job_command(0x2A, col, 4); // column address set
+	job_command(0x2B, row, 4); // row address set
+	job_command(0x2C, NULL, 0); // memory write
+	job_start(data, len);
+
+	if (data == display_bufs[display_buf_next])
+		display_buf_next = (display_buf_next + 1) % DISPLAY_RENDER_BUFS;
 }
 
 int display_ready(void)
 {
-	if(display_doing_dma) {
-		if(LDMA_TransferDone(DISPLAY_DMA_CH))
-			display_doing_dma = 0;
-		else return 0;
-	}
 	return display_initialized;
 }
 
@@ -157,6 +256,7 @@ const uint16_t display_init_commands[] = {
 int display_init(void)
 {
 	display_initialized = 0;
+	myhandle = xTaskGetCurrentTaskHandle();
 	unsigned i;
 	for (i = 0;; i++) {
 		unsigned c = display_init_commands[i];
@@ -177,9 +277,10 @@ int display_init(void)
 
 void display_scroll(unsigned y)
 {
-	writecommand(0x37);
-	writedata(y>>8);
-	writedata(y);
+	display_sync();
+	const uint8_t d[2] = { y>>8, y };
+	job_command(0x37, d, 2); // vertical scrolling start address
+	job_start(NULL, 0);
 }
 
 void display_backlight(int b)
@@ -18,15 +18,24 @@
 #ifndef DSP_TEST
 #include "ui.h"
 #include "ui_parameters.h"
+#include "diagnostics.h"
+#include "railtask.h"
 #endif
 
 #include "dsp.h"
 #include "dsp_math.h"
+#include "capture.h"
+#include "record.h"
 
 #include <assert.h>
 #include <math.h>
 #include <string.h>
 
+#ifdef DSP_TEST
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#endif
+
 #define AUDIO_MAXLEN 32
 #define IQ_MAXLEN (AUDIO_MAXLEN * 2)
 // Frequency step of FM modulator
@@ -48,6 +57,36 @@ QueueHandle_t fft_queue;
 #define SIGNALBUFLEN 512
 int16_t signalbuf[2*SIGNALBUFLEN];
 
+/* FFT queue messages have the index of the latest sample
+ * in signalbuf in the low bits. Messages with FFT_MSG_SCOPE set are
+ * band scope captures instead of normal waterfall FFTs, and also
+ * have the step and capture number. Steps that could not be tuned
+ * are sent with FFT_MSG_SCOPE_SKIP, so that only slow DSP builds
+ * the band scope line. */
+#define FFT_MSG_SCOPE      0x80000000UL
+#define FFT_MSG_SCOPE_SKIP 0x40000000UL
+#define FFT_MSG_INDEX(m)   ((m) & 0xFFFF)
+#define FFT_MSG_STEP_SHIFT 16
+#define FFT_MSG_STEP(m)    (((m) >> FFT_MSG_STEP_SHIFT) & 0xFF)
+#define FFT_MSG_NUM_SHIFT  24
+#define FFT_MSG_NUM(m)     (((m) >> FFT_MSG_NUM_SHIFT) & 0x3F)
+// FFT length used for band scope
+#define SCOPE_FFTLEN 64
+// Samples skipped after retuning before a band scope capture
+#define SCOPE_SKIP_SAMPLES 128
+
+/* Band scope state, shared by the RAIL task and DSP tasks.
+ * Only one step is captured at a time. Each capture gets a number,
+ * so a capture still in the queue after the sweep has moved on
+ * to the next step is recognized and dropped. */
+struct scope {
+	// Step being captured and its capture number
+	volatile unsigned step, num;
+	// Number of the latest capture processed by slow DSP
+	volatile unsigned done_num;
+};
+static struct scope scope;
+
 
 static inline float clip(float v, float threshold)
 {
@@ -138,6 +177,12 @@ struct demod {
 	// Frequency of the digital down-converter
 	float ddcfreq_i, ddcfreq_q;
 
+	// Phase and frequency of the fine tuning mixer used in FM and AM
+	float mix_i, mix_q;
+	float mixfreq_i, mixfreq_q;
+	// 1 if fine tuning is used, 0 if the mixer is bypassed
+	char mix_on;
+
 	// Phase of the second oscillator in SSB demodulation
 	float bfo_i, bfo_q;
 	// Frequency of the second oscillator in SSB demodulation
@@ -153,7 +198,22 @@ struct demod {
 	float agc_amp;
 
 	// Squelch state
-	float diff_avg, squelch;
+	float diff_avg, squelch, squelch_power;
+	// Squelch metric of the latest block
+	float diff_block;
+	// 1 while squelch is closed and audio output is parked
+	volatile char squelch_closed;
+
+	// Samples left before a band scope capture is ready, 0 if none
+	volatile unsigned capture_samples;
+
+	/* Squelch measurement after retuning.
+	 * settle_count counts blocks since restart,
+	 * settle_power is the average signal power per sample,
+	 * power_block the power of the latest block. */
+	unsigned settle_count;
+	float settle_power, power_block;
+	volatile char settle_restart;
 
 	// S-meter state
 	uint64_t smeter_acc;
@@ -175,9 +235,10 @@ static void demod_reset(struct demod *ds)
 	ds->fm_prev_i = ds->fm_prev_q = 0;
 	ds->audio_lpf = ds->audio_hpf = ds->audio_po = 0;
 	ds->agc_amp = 0;
-	ds->diff_avg = 0;
+	ds->diff_avg = ds->diff_block = 0;
 	ds->bfo_i = 1; ds->bfo_q = 0;
 	ds->ddc_i = 1; ds->ddc_q = 0;
+	ds->mix_i = 1; ds->mix_q = 0;
 	memset(&ds->bq, 0, sizeof(ds->bq));
 }
 
@@ -187,7 +248,7 @@ static void demod_reset(struct demod *ds)
 void demod_store(struct demod *ds, iq_in_t *in, unsigned len)
 {
 	unsigned i, fp = ds->signalbufp;
-	uint64_t acc = ds->smeter_acc;
+	uint64_t acc = ds->smeter_acc, acc_start = acc;
 	for (i = 0; i < len; i += 2) {
 		int32_t s0i, s0q, s1i, s1q;
 		s0i = in[i].i;
@@ -199,15 +260,31 @@ void demod_store(struct demod *ds, iq_in_t *in, unsigned len)
 		acc += s0i * s0i + s0q * s0q;
 		acc += s1i * s1i + s1q * s1q;
 		fp = (fp + 2) & (SIGNALBUFLEN-2);
-		if (fp == 0 || fp == 171*2 || fp == 341*2) {
+		if (p.scan != SCAN_SCOPE && (fp == 0 || fp == 171*2 || fp == 341*2)) {
 #ifndef DSP_TEST
-			uint16_t msg = fp;
+			uint32_t msg = fp;
 			if (!xQueueSend(fft_queue, &msg, 0)) {
 				//++diag.fft_overflows;
 			}
 #endif
 		}
 	}
+	ds->power_block = (float)(acc - acc_start) / len;
+	unsigned capture = ds->capture_samples;
+	if (capture > 0) {
+		if (capture <= len) {
+			capture = 0;
+#ifndef DSP_TEST
+			uint32_t msg = fp | FFT_MSG_SCOPE
+				| scope.step << FFT_MSG_STEP_SHIFT
+				| scope.num << FFT_MSG_NUM_SHIFT;
+			xQueueSend(fft_queue, &msg, 0);
+#endif
+		} else {
+			capture -= len;
+		}
+		ds->capture_samples = capture;
+	}
 	if((ds->smeter_count += len) >= 0x4000) {
 		/* Update S-meter value on display */
 		rs.smeter = acc / 0x4000;
@@ -244,7 +321,7 @@ void demod_store(struct demod *ds, iq_in_t *in, unsigned len)
  *
  * Average amplitude of differentiated signal is used for squelch.
  */
-/*static inline*/ void demod_fm(struct demod *ds, iq_in_t *in, float *out, unsigned len)
+/*static inline*/ void demod_fm(struct demod *ds, iq_float_t *in, float *out, unsigned len)
 {
 	unsigned i;
 	float s0i, s0q, s1i, s1q;
@@ -282,6 +359,62 @@ void demod_store(struct demod *ds, iq_in_t *in, unsigned len)
 	float diff_avg = ds->diff_avg;
 	if (diff_avg != diff_avg) diff_avg = 0;
 	ds->diff_avg = diff_avg + (diff_amp - diff_avg) * .02f;
+	ds->diff_block = diff_amp;
+}
+
+
+// Output sample pairs skipped between those measured by demod_fm_squelch
+#define SQUELCH_DECIMATION 4
+
+/* Squelch metric for FM while squelch is closed.
+ *
+ * Nothing needs to be heard then, so instead of demodulating
+ * everything, only every SQUELCH_DECIMATION-th pair of audio samples
+ * is demodulated, the same way as in demod_fm, and the metric
+ * is scaled up to match the one from demod_fm.
+ * Pairs of consecutive samples are used so that the metric is
+ * measured on the same audio sample rate as in demod_fm.
+ *
+ * The fine tuning mixer is also skipped, since a frequency offset
+ * only adds a constant to demodulated audio and the differences
+ * between samples stay about the same.
+ */
+void demod_fm_squelch(struct demod *ds, iq_in_t *in, unsigned len)
+{
+	unsigned i, n = 0;
+	float diff_amp = 0;
+	// Each pair of audio samples uses 5 I/Q samples,
+	// the first one being the previous sample of the first audio sample.
+	for (i = 1; i + 4 < len; i += 4 * SQUELCH_DECIMATION) {
+		float fm[2];
+		unsigned j;
+		for (j = 0; j < 2; j++) {
+			const iq_in_t *s = &in[i + 2*j];
+			float s0i = s[-1].i, s0q = s[-1].q;
+			float s1i = s[0].i,  s1q = s[0].q;
+			float s2i = s[1].i,  s2q = s[1].q;
+			float fi, fq, f;
+			fi = s1i * s0i + s1q * s0q;
+			fq = s1q * s0i - s1i * s0q;
+			f = fq / (fabsf(fi) + fabsf(fq));
+			fi += s2i * s1i + s2q * s1q;
+			fq += s2q * s1i - s2i * s1q;
+			f += fq / (fabsf(fi) + fabsf(fq));
+			// Avoid NaN
+			if (f != f)
+				f = 0;
+			fm[j] = f;
+		}
+		diff_amp += fabsf(fm[1] - fm[0]);
+		n++;
+	}
+	if (n > 0)
+		diff_amp *= (float)(len / 2) / (float)n;
+
+	float diff_avg = ds->diff_avg;
+	if (diff_avg != diff_avg) diff_avg = 0;
+	ds->diff_avg = diff_avg + (diff_amp - diff_avg) * .02f;
+	ds->diff_block = diff_amp;
 }
 
 
@@ -291,24 +424,59 @@ void demod_store(struct demod *ds, iq_in_t *in, unsigned len)
  * An approximation explained here is used:
  * https://dspguru.com/dsp/tricks/magnitude-estimator/
  */
-/*static inline*/ void demod_am(struct demod *ds, iq_in_t *in, float *out, unsigned len)
+/*static inline*/ void demod_am(struct demod *ds, iq_float_t *in, float *out, unsigned len)
 {
 	(void)ds;
 	unsigned i;
 	const float beta = 0.4142f;
 	for (i = 0; i < len; i+=2) {
 		float ai, aq, o;
-		ai = fabsf((float)in[i].i);
-		aq = fabsf((float)in[i].q);
+		ai = fabsf(in[i].i);
+		aq = fabsf(in[i].q);
 		o = (ai >= aq) ? (ai + aq * beta) : (aq + ai * beta);
-		ai = fabsf((float)in[i+1].i);
-		aq = fabsf((float)in[i+1].q);
+		ai = fabsf(in[i+1].i);
+		aq = fabsf(in[i+1].q);
 		o += (ai >= aq) ? (ai + aq * beta) : (aq + ai * beta);
 		out[i/2] = o;
 	}
 }
 
 
+/* Fine tuning mixer for FM and AM.
+ *
+ * Convert samples to floating point and shift them in frequency
+ * by the fine tuning offset, so that small tuning steps do not
+ * need retuning the synthesizer.
+ * The oscillator works like the one in demod_ddc.
+ * If fine tuning is not used, samples are only converted.
+ */
+void demod_mix(struct demod *ds, iq_in_t *in, iq_float_t *out, unsigned len)
+{
+	unsigned i;
+	if (!ds->mix_on) {
+		for (i = 0; i < len; i++) {
+			out[i].i = in[i].i;
+			out[i].q = in[i].q;
+		}
+		return;
+	}
+	float osci = ds->mix_i, oscq = ds->mix_q;
+	const float oscfi = ds->mixfreq_i, oscfq = ds->mixfreq_q;
+	for (i = 0; i < len; i++) {
+		float ii = in[i].i, iq = in[i].q, o;
+		out[i].i = osci * ii - oscq * iq;
+		out[i].q = osci * iq + oscq * ii;
+		o     = osci * oscfi - oscq * oscfq;
+		oscq  = osci * oscfq + oscq * oscfi;
+		osci  = o;
+	}
+	float ms = osci * osci + oscq * oscq;
+	ms = (3.0f - ms) * 0.5f;
+	ds->mix_i = ms * osci;
+	ds->mix_q = ms * oscq;
+}
+
+
 /* Digital down-conversion.
  * This is the first mixer in the Weaver method SSB demodulator.
  *
@@ -503,22 +671,150 @@ void demod_ssb(struct demod *ds, iq_in_t *in, float *out, unsigned len)
 
 struct demod demodstate;
 
+// Blocks ignored after retuning while the synthesizer settles
+#define SETTLE_SKIP_BLOCKS 2
+// Blocks averaged after that to measure squelch
+#define SETTLE_BLOCKS 10
+
+/* Measure squelch quickly after retuning.
+ *
+ * The normal squelch average responds too slowly for scanning,
+ * so after a restart, the first blocks are skipped and then
+ * the squelch metric is replaced by the plain average of the
+ * following blocks. Once enough blocks have been averaged,
+ * the normal squelch averaging continues from that value.
+ * Squelch is kept closed until then.
+ * Only FM computes the squelch metric, so the signal power
+ * is measured in every mode but the metric only in FM.
+ *
+ * Return 1 if squelch should be kept closed. */
+static int demod_settle(struct demod *ds)
+{
+	if (ds->settle_restart) {
+		ds->settle_restart = 0;
+		ds->settle_count = 0;
+	}
+	unsigned n = ds->settle_count;
+	if (n >= SETTLE_SKIP_BLOCKS + SETTLE_BLOCKS) {
+		ds->settle_power += (ds->power_block - ds->settle_power) * .02f;
+		return 0;
+	}
+	int fm = ds->mode == MODE_FM;
+	ds->settle_count = ++n;
+	if (n <= SETTLE_SKIP_BLOCKS) {
+		if (fm)
+			ds->diff_avg = ds->diff_block;
+		ds->settle_power = ds->power_block;
+		return 1;
+	}
+	float a = 1.0f / (float)(n - SETTLE_SKIP_BLOCKS);
+	if (fm)
+		ds->diff_avg += (ds->diff_block - ds->diff_avg) * a;
+	ds->settle_power += (ds->power_block - ds->settle_power) * a;
+	if (n == SETTLE_SKIP_BLOCKS + SETTLE_BLOCKS) {
+#ifndef DSP_TEST
+		// Let the scanner know the measurement is ready
+		xSemaphoreGive(railtask_sem);
+#endif
+		return 0;
+	}
+	return 1;
+}
+
+/* FM squelch uses the squelch metric, which is low for a signal.
+ * Audio in other modes is not squelched. */
+static int demod_squelch_open(const struct demod *ds)
+{
+	return ds->mode != MODE_FM || ds->diff_avg < ds->squelch;
+}
+
+/* Parameter changes waiting for the start of the next block.
+ * Changes only take effect between blocks, so every block is
+ * processed with one set of parameters and a recording
+ * can tell exactly which block they changed in. */
+static struct {
+	struct dsp_params next;
+	// Number of updates set and number applied
+	volatile unsigned updates, applied;
+	volatile char squelch_restart;
+} params_pending;
+
+static void dsp_apply_params(void);
+
+void dsp_squelch_restart(void)
+{
+	params_pending.squelch_restart = 1;
+}
+
+int dsp_squelch_settled(void)
+{
+	return !params_pending.squelch_restart && !demodstate.settle_restart
+		&& demodstate.settle_count >= SETTLE_SKIP_BLOCKS + SETTLE_BLOCKS;
+}
+
+void dsp_scope_capture(unsigned step)
+{
+	// Stop a previous capture before numbering the new one
+	demodstate.capture_samples = 0;
+	scope.step = step;
+	scope.num = (scope.num + 1) & 0x3F;
+	demodstate.capture_samples = SCOPE_SKIP_SAMPLES + 2*SCOPE_FFTLEN;
+}
+
+int dsp_scope_done(void)
+{
+	return scope.done_num == scope.num;
+}
+
+int dsp_audio_parked(void)
+{
+	return demodstate.squelch_closed;
+}
+
+int dsp_signal_present(void)
+{
+	if (demodstate.mode == MODE_FM)
+		return demod_squelch_open(&demodstate);
+	return demodstate.settle_power >= demodstate.squelch_power;
+}
+
 /* Function to convert received IQ to output audio */
 int dsp_fast_rx(iq_in_t *in, int in_len, audio_out_t *out, int out_len)
 {
 	if (out_len * 2 != in_len || out_len > AUDIO_MAXLEN)
 		return 0;
 
+	dsp_apply_params();
+	RECORD_HOOK(record_begin());
 	demod_store(&demodstate, in, in_len);
+	CAPTURE_TAP(CAPTURE_RX_IQ, capture_iq_in(in, in_len));
 
 	enum rig_mode mode = demodstate.mode;
 	float audio[AUDIO_MAXLEN];
+	iq_float_t buf[IQ_MAXLEN];
+	/* While squelch is closed, only measure squelch.
+	 * The measurement is not reduced while it settles after
+	 * retuning, so that scanning sees the full measurement.
+	 * The block where squelch opens stays silent
+	 * and the full chain runs from the next one. */
+	int quiet = demodstate.squelch_closed && dsp_squelch_settled();
 	switch(mode) {
 	case MODE_FM:
-		demod_fm(&demodstate, in, audio, in_len);
+		if (quiet) {
+			demod_fm_squelch(&demodstate, in, in_len);
+#ifndef DSP_TEST
+			++diag.rx_blocks_quiet;
+#endif
+			break;
+		}
+		demod_mix(&demodstate, in, buf, in_len);
+		CAPTURE_TAP(CAPTURE_RX_MIXED, capture_iq_float(buf, in_len));
+		demod_fm(&demodstate, buf, audio, in_len);
 		break;
 	case MODE_AM:
-		demod_am(&demodstate, in, audio, in_len);
+		demod_mix(&demodstate, in, buf, in_len);
+		CAPTURE_TAP(CAPTURE_RX_MIXED, capture_iq_float(buf, in_len));
+		demod_am(&demodstate, buf, audio, in_len);
 		break;
 	case MODE_USB:
 	case MODE_LSB:
@@ -530,8 +826,11 @@ int dsp_fast_rx(iq_in_t *in, int in_len, audio_out_t *out, int out_len)
 		break;
 	}
 
-	if (demodstate.diff_avg < demodstate.squelch) {
+	int settling = demod_settle(&demodstate);
+	int open = !settling && demod_squelch_open(&demodstate);
+	if (open && !(quiet && mode == MODE_FM)) {
 		// Squelch open
+		CAPTURE_TAP(CAPTURE_RX_DEMOD, capture_float(CAPTURE_RX_DEMOD, audio, out_len));
 		demod_audio_filter(&demodstate, audio, out_len);
 		demod_convert_audio(audio, out, out_len, demodstate.audiogain / demodstate.agc_amp);
 	} else {
@@ -540,6 +839,9 @@ int dsp_fast_rx(iq_in_t *in, int in_len, audio_out_t *out, int out_len)
 		for (i = 0; i < out_len; i++)
 			out[i] = AUDIO_MID;
 	}
+	demodstate.squelch_closed = !open;
+	CAPTURE_TAP(CAPTURE_RX_AUDIO, capture_u16(CAPTURE_RX_AUDIO, out, out_len, AUDIO_MID));
+	RECORD_HOOK(record_rx(in, in_len, out, out_len));
 
 	return out_len;
 }
@@ -929,11 +1231,15 @@ int dsp_fast_tx(audio_in_t *in, fm_out_t *out, int len)
 	float audio[AUDIO_MAXLEN];
 	assert (len <= AUDIO_MAXLEN);
 
+	dsp_apply_params();
+	RECORD_HOOK(record_begin());
+	// The ADC oversamples to 15 bits, so mid-scale is about 1 << 14
+	CAPTURE_TAP(CAPTURE_TX_MIC, capture_u16(CAPTURE_TX_MIC, in, len, 1 << 14));
 	mod_process_audio(m, in, audio, len);
 
 	int i;
 
-	switch (p.mode) {
+	switch (m->mode) {
 	case MODE_FM:
 		mod_fm(m, audio, out, len);
 		break;
@@ -947,6 +1253,7 @@ int dsp_fast_tx(audio_in_t *in, fm_out_t *out, int len)
 			out[i] = 32;
 		}
 	}
+	RECORD_HOOK(record_tx(in, out, len));
 	return 0;
 }
 
@@ -954,6 +1261,7 @@ int dsp_fast_tx(audio_in_t *in, fm_out_t *out, int len)
 void dsp_update_params(void)
 {
 	enum rig_mode mode = p.mode;
+	struct dsp_params n;
 
 	float bfo = 0.0f, ddc_offset = 0.0f;
 	float bfo_tx = 0.0f;
@@ -982,47 +1290,126 @@ void dsp_update_params(void)
 
 	float f;
 	f = (6.2831853f * 2.0f / RX_IQ_FS) * bfo;
-	demodstate.bfofreq_i = cosf(f);
-	demodstate.bfofreq_q = sinf(f);
+	n.bfofreq_i = cosf(f);
+	n.bfofreq_q = sinf(f);
+
+	int32_t finetune = rs.rx_finetune;
+	f = (-6.2831853f / RX_IQ_FS) * ((float)p.offset_freq + ddc_offset + (float)finetune);
+	n.ddcfreq_i = cosf(f);
+	n.ddcfreq_q = sinf(f);
 
-	f = (-6.2831853f / RX_IQ_FS) * ((float)p.offset_freq + ddc_offset);
-	demodstate.ddcfreq_i = cosf(f);
-	demodstate.ddcfreq_q = sinf(f);
+	f = (-6.2831853f / RX_IQ_FS) * (float)finetune;
+	n.mixfreq_i = cosf(f);
+	n.mixfreq_q = sinf(f);
+	n.mix_on = finetune != 0;
 
 	f = (6.2831853f / TX_FS) * bfo_tx;
-	modstate.bfofreq_i = cosf(f);
-	modstate.bfofreq_q = sinf(f);
+	n.tx_bfofreq_i = cosf(f);
+	n.tx_bfofreq_q = sinf(f);
 
 	float ctcss = p.ctcss;
 	if (mode == MODE_FM && ctcss != 0.0f) {
 		f = (6.2831853f / TX_FS) * ctcss;
-		modstate.ctfreq_i = cosf(f);
-		modstate.ctfreq_q = sinf(f);
+		n.ctfreq_i = cosf(f);
+		n.ctfreq_q = sinf(f);
 	} else {
-		modstate.ctfreq_i = 1.0f;
-		modstate.ctfreq_q = 0.0f;
+		n.ctfreq_i = 1.0f;
+		n.ctfreq_q = 0.0f;
 	}
 
 	unsigned vola = p.volume;
-	demodstate.audiogain = ((vola&1) ? (3<<(vola/2)) : (2<<(vola/2))) * 10.0f;
+	n.audiogain = ((vola&1) ? (3<<(vola/2)) : (2<<(vola/2))) * 10.0f;
 
-	demodstate.squelch = 1.0f * p.squelch;
+	n.squelch = 1.0f * p.squelch;
+	// In other modes than FM, squelch setting is a power level in dB
+	n.squelch_power = powf(10.0f, 0.1f * (float)p.squelch) - 1.0f;
+
+	n.mode = mode;
+	dsp_set_params(&n);
+}
 
-	demodstate.mode = mode;
-	modstate.mode = mode;
-	/* Reset state after mode change */
-	if (mode != demodstate.prev_mode) {
-		demod_reset(&demodstate);
-		mod_reset(&modstate);
-		demodstate.prev_mode = mode;
+
+void dsp_set_params(const struct dsp_params *params)
+{
+	taskENTER_CRITICAL();
+	params_pending.next = *params;
+	params_pending.updates++;
+	taskEXIT_CRITICAL();
+}
+
+
+/* Apply parameter changes at the start of a block.
+ * Called from the fast DSP task only. */
+static void dsp_apply_params(void)
+{
+	if (params_pending.applied != params_pending.updates) {
+		struct dsp_params n;
+		taskENTER_CRITICAL();
+		n = params_pending.next;
+		params_pending.applied = params_pending.updates;
+		taskEXIT_CRITICAL();
+
+		demodstate.bfofreq_i = n.bfofreq_i;
+		demodstate.bfofreq_q = n.bfofreq_q;
+		demodstate.ddcfreq_i = n.ddcfreq_i;
+		demodstate.ddcfreq_q = n.ddcfreq_q;
+		demodstate.mixfreq_i = n.mixfreq_i;
+		demodstate.mixfreq_q = n.mixfreq_q;
+		demodstate.mix_on = n.mix_on;
+		demodstate.audiogain = n.audiogain;
+		demodstate.squelch = n.squelch;
+		demodstate.squelch_power = n.squelch_power;
+		modstate.bfofreq_i = n.tx_bfofreq_i;
+		modstate.bfofreq_q = n.tx_bfofreq_q;
+		modstate.ctfreq_i = n.ctfreq_i;
+		modstate.ctfreq_q = n.ctfreq_q;
+
+		enum rig_mode mode = n.mode;
+		demodstate.mode = mode;
+		modstate.mode = mode;
+		/* Reset state after mode change */
+		if (mode != demodstate.prev_mode) {
+			demod_reset(&demodstate);
+			mod_reset(&modstate);
+			demodstate.prev_mode = mode;
+		}
+		RECORD_HOOK(record_params(&n));
+	}
+	if (params_pending.squelch_restart) {
+		// Set the flag before clearing the request,
+		// so dsp_squelch_settled never misses both
+		demodstate.settle_restart = 1;
+		params_pending.squelch_restart = 0;
+		RECORD_HOOK(record_squelch_restart());
 	}
 }
 
 
 #ifndef DSP_TEST
+/* Convert a value to a waterfall pixel color */
+static void waterfall_color(unsigned v, uint8_t *bufp)
+{
+	if(v < 0x100) {  // black to blue
+		bufp[0] = v / 2;
+		bufp[1] = 0;
+		bufp[2] = v;
+	} else if(v < 0x200) { // blue to yellow
+		bufp[0] = v / 2;
+		bufp[1] = v - 0x100;
+		bufp[2] = 0x1FF - v;
+	} else if(v < 0x300) { // yellow to white
+		bufp[0] = 0xFF;
+		bufp[1] = 0xFF;
+		bufp[2] = v - 0x200;
+	} else { // white
+		bufp[0] = 0xFF;
+		bufp[1] = 0xFF;
+		bufp[2] = 0xFF;
+	}
+}
+
 static void calculate_waterfall_line(unsigned sbp)
 {
-	extern uint8_t displaybuf2[3*(FFT_BIN2-FFT_BIN1)];
 	unsigned i;
 	float mag_avg = 0;
 
@@ -1032,7 +1419,18 @@ static void calculate_waterfall_line(unsigned sbp)
 	 * with some changes to indexing.
 	 */
 	static float fftdata[2*FFTLEN], mag[FFTLEN];
-	static uint8_t averages = 0;
+	static uint8_t averages = 0, computed = 0;
+
+	/* When the display is idle, the waterfall is hardly looked at,
+	 * so only the last FFT of each line is computed instead of
+	 * averaging. Lines still come at the same rate, so the waterfall
+	 * history is up to date when the user wakes the display up. */
+	averages++;
+	int last = averages >= p.waterfall_averages;
+	if (!last && ui_is_idle()) {
+		++diag.waterfall_ffts_skipped;
+		return;
+	}
 
 	/* sbp is the message received from the fast DSP task,
 	 * containing the index of the latest sample written by it.
@@ -1048,54 +1446,144 @@ static void calculate_waterfall_line(unsigned sbp)
 
 	arm_cfft_f32(fftS, fftdata, 0, 1);
 
-	if(averages == 0)
+	if(computed == 0)
 		for(i=0;i<FFTLEN;i++) mag[i] = 0;
 	for(i=0;i<FFTLEN;i++) {
 		float fft_i = fftdata[2*i], fft_q = fftdata[2*i+1];
 		mag_avg +=
 		mag[i ^ (FFTLEN/2)] += fft_i*fft_i + fft_q*fft_q;
 	}
-	averages++;
-	if(averages < p.waterfall_averages)
+	computed++;
+	if(!last)
 		return;
 	averages = 0;
+	computed = 0;
 	mag_avg = (130.0f*FFTLEN) / mag_avg;
 
-	uint8_t *bufp = displaybuf2;
+	uint8_t *bufp = ui_waterfall_line_begin();
+	if (bufp == NULL)
+		return;
 	for(i=FFT_BIN1;i<FFT_BIN2;i++) {
-		unsigned v = mag[i] * mag_avg;
-		if(v < 0x100) {  // black to blue
-			bufp[0] = v / 2;
-			bufp[1] = 0;
-			bufp[2] = v;
-		} else if(v < 0x200) { // blue to yellow
-			bufp[0] = v / 2;
-			bufp[1] = v - 0x100;
-			bufp[2] = 0x1FF - v;
-		} else if(v < 0x300) { // yellow to white
-			bufp[0] = 0xFF;
-			bufp[1] = 0xFF;
-			bufp[2] = v - 0x200;
-		} else { // white
-			bufp[0] = 0xFF;
-			bufp[1] = 0xFF;
-			bufp[2] = 0xFF;
-		}
+		waterfall_color(mag[i] * mag_avg, bufp);
 		bufp += 3;
 	}
 
-	display_ev.waterfall_line = 1;
-	xSemaphoreGive(display_sem);
+	ui_waterfall_line_done();
+}
+
+
+/* Store the two pixels of a band scope step.
+ * When the last step is done, the line is passed to the waterfall. */
+static void scope_store(unsigned step, float below, float above)
+{
+	static float mag[FFT_BIN2-FFT_BIN1];
+	unsigned i;
+	if (step < SCOPE_STEPS) {
+		mag[2*step]   = below;
+		mag[2*step+1] = above;
+	}
+
+	if (step == SCOPE_STEPS-1) {
+		float mag_avg = 0;
+		for (i = 0; i < FFT_BIN2-FFT_BIN1; i++)
+			mag_avg += mag[i];
+		if (mag_avg > 0)
+			mag_avg = (130.0f*(FFT_BIN2-FFT_BIN1)) / mag_avg;
+		uint8_t *bufp = ui_waterfall_line_begin();
+		if (bufp != NULL) {
+			for (i = 0; i < FFT_BIN2-FFT_BIN1; i++) {
+				waterfall_color(mag[i] * mag_avg, bufp);
+				bufp += 3;
+			}
+			ui_waterfall_line_done();
+		}
+	}
+}
+
+/* Skip a step which could not be tuned.
+ * The step is stored as empty by slow DSP.
+ * If the queue is full, the scanner moves on after its timeout. */
+void dsp_scope_skip(unsigned step)
+{
+	demodstate.capture_samples = 0;
+	scope.step = step;
+	scope.num = (scope.num + 1) & 0x3F;
+	uint32_t msg = FFT_MSG_SCOPE | FFT_MSG_SCOPE_SKIP
+		| step << FFT_MSG_STEP_SHIFT
+		| scope.num << FFT_MSG_NUM_SHIFT;
+	xQueueSend(fft_queue, &msg, 0);
+}
+
+/* Measure a band scope capture.
+ * Each sweep step gives two pixels of the band scope line:
+ * the strongest FFT bin below and above the tuned frequency,
+ * within half a step. The DC bin is left out since it contains
+ * the local oscillator leakage. */
+static void scope_measure(unsigned sbp, float *below, float *above)
+{
+	static float fftdata[2*SCOPE_FFTLEN];
+	unsigned i;
+
+	sbp -= 2*SCOPE_FFTLEN;
+	for(i=0; i<2*SCOPE_FFTLEN; i+=2) {
+		sbp &= SIGNALBUFLEN-1;
+		fftdata[i]   = signalbuf[sbp];
+		fftdata[i+1] = signalbuf[sbp+1];
+		sbp += 2;
+	}
+	arm_cfft_f32(&arm_cfft_sR_f32_len64, fftdata, 0, 1);
+
+	// Bins in half a step, up to the usable bandwidth
+	const float bin_hz = (RX_IQ_FS/2) / SCOPE_FFTLEN;
+	unsigned h = (float)p.scan_span / SCOPE_STEPS / 2 / bin_hz;
+	if (h < 1) h = 1;
+	if (h > SCOPE_FFTLEN/4) h = SCOPE_FFTLEN/4;
+
+	for (i = 1; i <= h; i++) {
+		float *b = &fftdata[2*(SCOPE_FFTLEN-i)], *a = &fftdata[2*i];
+		float pb = b[0]*b[0] + b[1]*b[1], pa = a[0]*a[0] + a[1]*a[1];
+		if (pb > *below) *below = pb;
+		if (pa > *above) *above = pa;
+	}
+}
+
+/* Process a band scope message. Skipped steps are stored as empty. */
+static void calculate_scope_step(uint32_t msg)
+{
+	unsigned num = FFT_MSG_NUM(msg);
+	// Captured before the sweep moved on
+	if (num != scope.num)
+		return;
+	float below = 0, above = 0;
+	if (!(msg & FFT_MSG_SCOPE_SKIP))
+		scope_measure(FFT_MSG_INDEX(msg), &below, &above);
+	scope_store(FFT_MSG_STEP(msg), below, above);
+	scope.done_num = num;
+	xSemaphoreGive(railtask_sem);
 }
 
 
 /* A task for DSP operations that can take a longer time */
 void slow_dsp_task(void *arg) {
 	(void)arg;
+	uint32_t cyc1, cyc_prev = DWT->CYCCNT, cycles_prev = 0;
 	for(;;) {
-		uint16_t msg;
+		uint32_t msg;
 		if (xQueueReceive(fft_queue, &msg, portMAX_DELAY)) {
-			calculate_waterfall_line(msg);
+			cyc1 = DWT->CYCCNT;
+			if (msg & FFT_MSG_SCOPE)
+				calculate_scope_step(msg);
+			else if (p.scan != SCAN_SCOPE)
+				calculate_waterfall_line(FFT_MSG_INDEX(msg));
+			diag.cycles_waterfall += DWT->CYCCNT - cyc1;
+		}
+		// Update estimate of CPU usage about once a second
+		uint32_t diff = diag.cycles_waterfall - cycles_prev;
+		uint32_t elapsed = DWT->CYCCNT - cyc_prev;
+		if (elapsed >= 38400000UL) {
+			diag.waterfall_cpu_use = (float)diff / (float)elapsed;
+			cycles_prev = diag.cycles_waterfall;
+			cyc_prev += elapsed;
 		}
 	}
 }
@@ -1103,6 +1591,6 @@ void slow_dsp_task(void *arg) {
 
 void slow_dsp_rtos_init(void)
 {
-	fft_queue = xQueueCreate(1, sizeof(uint16_t));
+	fft_queue = xQueueCreate(1, sizeof(uint32_t));
 }
 #endif
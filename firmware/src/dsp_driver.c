@@ -10,10 +10,15 @@
 #include "rail.h"
 
 #include "FreeRTOS.h"
+#include "task.h"
 #include "queue.h"
 
 #include "dsp.h"
 #include "dsp_driver.h"
+#include "diagnostics.h"
+#include "bootprof.h"
+#include "railtask.h"
+#include "trace.h"
 
 #include <stdio.h>
 
@@ -92,18 +97,6 @@
  * Buffers and data types
  * ---------------------- */
 
-/* Diagnostics, could be moved to some more global place */
-struct diagnostics {
-	uint32_t rx_blocks_overflow, rx_blocks_isr, rx_blocks_task;
-	uint32_t rx_rail_underruns, rx_samples_isr;
-	uint32_t tx_blocks_overflow, tx_blocks_isr, tx_blocks_task;
-
-	// Cycle counters to estimate CPU usage of fast DSP
-	uint32_t cycles_dsp, cycles_nodsp;
-
-	// Estimate of CPU time used by fast DSP
-	float dsp_cpu_use;
-};
 struct diagnostics diag;
 
 /* DSP driver state */
@@ -120,6 +113,16 @@ struct dsp_driver {
 	audio_in_t audio_in[TX_DSP_BLOCK * TX_BUF_BLOCKS];
 	// FM output buffer
 	fm_out_t fm_out[TX_DSP_BLOCK * TX_BUF_BLOCKS];
+	// Start time of receive latency measurement
+	uint32_t rx_latency_start;
+	// 1 if waiting for the first received block to measure latency
+	volatile char rx_latency_pending;
+	// 1 while audio output is held at the middle level
+	volatile char audio_parked;
+	// 1 while the speaker amplifier is shut down
+	char speaker_off;
+	// Tick count when audio output was parked
+	TickType_t parked_time;
 };
 struct dsp_driver dsp_driver;
 
@@ -151,18 +154,23 @@ void rail_callback(RAIL_Handle_t rail, RAIL_Events_t events)
 {
 	BaseType_t yield = 0;
 	struct dsp_driver *d = &dsp_driver;
+	diag_isr_enter();
+	TRACE_ISR_ENTER(TRACE_ISR_RAIL);
 	if (events & RAIL_EVENT_RX_FIFO_ALMOST_FULL) {
 		unsigned nread, i = d->rx_i;
 
-		uint32_t audio_out = d->audio_out[i];
-		TIMER_CompareBufSet(TIMER0, 0, audio_out);
+		if (!d->audio_parked) {
+			uint32_t audio_out = d->audio_out[i];
+			TIMER_CompareBufSet(TIMER0, 0, audio_out);
 #ifdef USE_OPAMPS
-		// DAC has more resolution than PWM so really bit depth
-		// should be increased in DSP code, but for now just scale
-		// it to use most of DAC range.
-		VDAC_Channel1OutputSet(VDAC0, audio_out * 20);
+			// DAC has more resolution than PWM so really bit depth
+			// should be increased in DSP code, but for now just scale
+			// it to use most of DAC range.
+			VDAC_Channel1OutputSet(VDAC0, audio_out * 20);
 #endif
+		}
 
+		boot_milestone(BOOT_FIRST_RX_BLOCK);
 		nread = RAIL_ReadRxFifo(rail, (uint8_t*)(d->iq_in + i * RX_SAMPLE_RATIO), sizeof(iq_in_t) * RX_SAMPLE_RATIO);
 		if (nread != sizeof(iq_in_t) * RX_SAMPLE_RATIO)
 			++diag.rx_rail_underruns;
@@ -178,9 +186,12 @@ void rail_callback(RAIL_Handle_t rail, RAIL_Events_t events)
 				RX_DSP_BLOCK * RX_SAMPLE_RATIO,
 				RX_DSP_BLOCK
 			};
-			if (xQueueSendFromISR(fast_dsp_rx_q, &msg, &yield))
+			if (xQueueSendFromISR(fast_dsp_rx_q, &msg, &yield)) {
 				++diag.rx_blocks_isr;
-			else
+				unsigned n = uxQueueMessagesWaitingFromISR(fast_dsp_rx_q);
+				if (n > diag.rx_queue_max)
+					diag.rx_queue_max = n;
+			} else
 				++diag.rx_blocks_overflow;
 		}
 
@@ -188,10 +199,57 @@ void rail_callback(RAIL_Handle_t rail, RAIL_Events_t events)
 			i = 0;
 		d->rx_i = i;
 	}
+	if (events & RAIL_EVENT_CAL_NEEDED) {
+		// Calibration is done in RAIL task
+		xSemaphoreGiveFromISR(railtask_sem, &yield);
+	}
+	TRACE_ISR_EXIT(TRACE_ISR_RAIL);
+	diag_isr_exit();
 	portYIELD_FROM_ISR(yield);
 }
 
 
+// Time audio has to stay parked before the speaker amplifier is shut down
+#define SPEAKER_OFF_DELAY pdMS_TO_TICKS(2000)
+
+/* Hold audio output at the middle level while squelch is closed,
+ * so the receive interrupt does not need to update it on every sample.
+ * The output buffer is still filled with silence, so audio continues
+ * from the buffer without a glitch once unparked.
+ *
+ * If the board has a speaker amplifier, it is shut down once audio
+ * has stayed parked for a while, so short pauses in a conversation
+ * do not switch it off and on. The amplifier takes a moment to start,
+ * so the start of audio after a long silence may be cut.
+ * Without an amplifier, the PWM keeps running, since stopping it
+ * would make a click through the speaker coupling capacitor. */
+static void dsp_park_audio(int park)
+{
+	struct dsp_driver *d = &dsp_driver;
+	if (park != d->audio_parked) {
+		d->audio_parked = park;
+		d->parked_time = xTaskGetTickCount();
+		if (park) {
+			TIMER_CompareBufSet(TIMER0, 0, AUDIO_MID);
+#ifdef USE_OPAMPS
+			VDAC_Channel1OutputSet(VDAC0, AUDIO_MID * 20);
+#endif
+		}
+	}
+#ifdef SPK_EN_PIN
+	if (!park && d->speaker_off) {
+		GPIO_PinOutClear(SPK_EN_PORT, SPK_EN_PIN);
+		d->speaker_off = 0;
+	} else if (park && !d->speaker_off
+		&& xTaskGetTickCount() - d->parked_time >= SPEAKER_OFF_DELAY) {
+		// Released pin is pulled up, which shuts the amplifier down
+		GPIO_PinOutSet(SPK_EN_PORT, SPK_EN_PIN);
+		d->speaker_off = 1;
+	}
+#endif
+}
+
+
 /* Set frequency synthesizer channel */
 static inline void synth_set_channel(uint32_t ch)
 {
@@ -200,10 +258,12 @@ static inline void synth_set_channel(uint32_t ch)
 
 
 /* ADC interrupt, used for transmission */
-void WTIMER0_IRQHandler(void)
+void TIMER1_IRQHandler(void)
 {
 	BaseType_t yield = 0;
 	struct dsp_driver *d = &dsp_driver;
+	diag_isr_enter();
+	TRACE_ISR_ENTER(TRACE_ISR_SAMPLE_TIMER);
 	unsigned i = d->tx_i;
 	synth_set_channel(d->fm_out[i]);
 	// ADC data should be available by now if ADC was started
@@ -220,9 +280,12 @@ void WTIMER0_IRQHandler(void)
 			d->fm_out + fi,
 			TX_DSP_BLOCK
 		};
-		if (xQueueSendFromISR(fast_dsp_tx_q, &msg, &yield))
+		if (xQueueSendFromISR(fast_dsp_tx_q, &msg, &yield)) {
 			++diag.tx_blocks_isr;
-		else
+			unsigned n = uxQueueMessagesWaitingFromISR(fast_dsp_tx_q);
+			if (n > diag.tx_queue_max)
+				diag.tx_queue_max = n;
+		} else
 			++diag.tx_blocks_overflow;
 	}
 
@@ -230,7 +293,9 @@ void WTIMER0_IRQHandler(void)
 		i = 0;
 	d->tx_i = i;
 
-	TIMER_IntClear(WTIMER0, TIMER_IF_CC0);
+	TIMER_IntClear(TIMER1, TIMER_IF_CC0);
+	TRACE_ISR_EXIT(TRACE_ISR_SAMPLE_TIMER);
+	diag_isr_exit();
 	portYIELD_FROM_ISR(yield);
 }
 
@@ -239,7 +304,7 @@ int start_rx_dsp(RAIL_Handle_t rail)
 {
 	// TODO clear the audio buffer for first round
 	unsigned r;
-	TIMER_IntDisable(WTIMER0, TIMER_IF_CC0);
+	TIMER_IntDisable(TIMER1, TIMER_IF_CC0);
 	RAIL_Idle(rail, RAIL_IDLE_ABORT, false);
 
 #ifdef MIC_EN_PIN
@@ -256,7 +321,10 @@ int start_rx_dsp(RAIL_Handle_t rail)
 	// so write the channel register too.
 	synth_set_channel(MIDDLECHANNEL);
 	r = RAIL_StartRx(rail, MIDDLECHANNEL, NULL);
-	printf("RAIL_StartRx: %u\n", r);
+	// Printing takes time, so only print errors
+	// to keep the receive turnaround fast.
+	if (r)
+		printf("RAIL_StartRx: %u\n", r);
 	return r;
 }
 
@@ -274,13 +342,20 @@ int start_tx_dsp(RAIL_Handle_t rail)
 #endif
 	RAIL_Idle(rail, RAIL_IDLE_ABORT, true);
 	RAIL_StartTxStream(rail, MIDDLECHANNEL, RAIL_STREAM_CARRIER_WAVE);
-	NVIC_EnableIRQ(WTIMER0_IRQn);
-	TIMER_IntEnable(WTIMER0, TIMER_IF_CC0);
+	NVIC_EnableIRQ(TIMER1_IRQn);
+	TIMER_IntEnable(TIMER1, TIMER_IF_CC0);
 	ADC_Start(ADC0, adcStartSingle);
 	return 0;
 }
 
 
+void dsp_measure_rx_latency(uint32_t start_cycles)
+{
+	dsp_driver.rx_latency_start = start_cycles;
+	dsp_driver.rx_latency_pending = 1;
+}
+
+
 
 void setup_opamps(void)
 {
@@ -371,14 +446,12 @@ void setup_opamps(void)
 
 void setup_adc(void)
 {
-	CMU_ClockEnable(cmuClock_WTIMER0, true);
+	CMU_ClockEnable(cmuClock_TIMER1, true);
 	CMU_ClockEnable(cmuClock_ADC0, true);
 
 	// Use timer to make an accurate 24 kHz sample rate for ADC.
-	// Maybe TIMER1 could be used instead of WTIMER0 if
-	// encoder decoding would be done using PCNT instead of TIMER1.
-	// This would lave WTIMER0 still free for other future use.
-	TIMER_Init(WTIMER0, &(const TIMER_Init_TypeDef) {
+	// Encoder is decoded by PCNT, so TIMER1 is free for this.
+	TIMER_Init(TIMER1, &(const TIMER_Init_TypeDef) {
 		.enable = 1,
 		.debugRun = 0,
 		.prescale = timerPrescale64,
@@ -393,7 +466,7 @@ void setup_adc(void)
 		.oneShot = 0,
 		.sync = 0,
 	});
-	TIMER_InitCC(WTIMER0, 0, &(const TIMER_InitCC_TypeDef) {
+	TIMER_InitCC(TIMER1, 0, &(const TIMER_InitCC_TypeDef) {
 		.eventCtrl = timerEventRising,
 		.edge = timerEdgeNone,
 		.prsSel = timerPRSSELCh0,
@@ -408,10 +481,10 @@ void setup_adc(void)
 		.prsOutput = timerPrsOutputDefault,
 	});
 	// Cycle length is top value + 1
-	TIMER_TopSet(WTIMER0, 24);
-	TIMER_CompareSet(WTIMER0, 0, 0);
+	TIMER_TopSet(TIMER1, 24);
+	TIMER_CompareSet(TIMER1, 0, 0);
 	// TODO: maybe enable it only during TX
-	TIMER_Enable(WTIMER0, 1);
+	TIMER_Enable(TIMER1, 1);
 
 	ADC_Init(ADC0, &(const ADC_Init_TypeDef) {
 		.ovsRateSel = adcOvsRateSel8,
@@ -481,6 +554,12 @@ void fast_dsp_task(void *arg)
 			if (xQueueReceive(q, &msg, 0)) {
 				dsp_fast_rx(msg.in, msg.in_len, msg.out, msg.out_len);
 				++diag.rx_blocks_task;
+				dsp_park_audio(dsp_audio_parked());
+				boot_milestone(BOOT_FIRST_AUDIO);
+				if (dsp_driver.rx_latency_pending) {
+					dsp_driver.rx_latency_pending = 0;
+					diag.unkey_rx_us = (uint64_t)(DWT->CYCCNT - dsp_driver.rx_latency_start) * 10 / 384;
+				}
 			}
 		} else if (q == fast_dsp_tx_q) {
 			struct fast_dsp_tx_msg msg;
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "freqplan.h"
+
+const struct freqplan_range *freqplan_lookup(uint32_t freq)
+{
+	uint32_t f = freq >> FREQPLAN_SHIFT;
+	// Binary search for the last range starting at or below f
+	unsigned lo = 0, hi = freqplan_table_len;
+	while (hi - lo > 1) {
+		unsigned mid = (lo + hi) / 2;
+		if (freqplan_table[mid].start <= f)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return &freqplan_table[lo];
+}
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: MIT */
+/* Generated by tools/freqplan_gen. Do not edit. */
+
+#include "freqplan.h"
+
+const struct freqplan_range freqplan_table[] = {
+#ifdef KAPULA_v2
+	{ 0x000000, 0x000,   0, 0 }, //    0.0000 MHz
+	{ 0x002b99, 0x16f, 175, 0 }, //   11.4289 MHz
+	{ 0x003efa, 0x12f, 140, 0 }, //   16.5089 MHz
+	{ 0x004adb, 0x16d, 125, 0 }, //   19.6229 MHz
+	{ 0x0053b3, 0x127, 112, 0 }, //   21.9412 MHz
+	{ 0x005b6a, 0x0ef, 105, 0 }, //   23.9636 MHz
+	{ 0x0060c4, 0x12d, 100, 0 }, //   25.3665 MHz
+	{ 0x006bcf, 0x0e7,  84, 0 }, //   28.2614 MHz
+	{ 0x0078f5, 0x125,  80, 0 }, //   31.7082 MHz
+	{ 0x007ffb, 0x0ed,  75, 0 }, //   33.5493 MHz
+	{ 0x0088ce, 0x0af,  70, 0 }, //   35.8625 MHz
+	{ 0x009409, 0x124,  64, 0 }, //   38.8065 MHz
+	{ 0x009c32, 0x0df,  63, 0 }, //   40.9457 MHz
+	{ 0x00a146, 0x0e5,  60, 0 }, //   42.2769 MHz
+	{ 0x00ab01, 0x0a7,  56, 0 }, //   44.8276 MHz
+	{ 0x00bb23, 0x0ad,  50, 0 }, //   49.0568 MHz
+	{ 0x00ca6a, 0x0e4,  48, 0 }, //   53.0616 MHz
+	{ 0x00d54c, 0x0dd,  45, 0 }, //   55.9145 MHz
+	{ 0x00e402, 0x09f,  42, 0 }, //   59.7709 MHz
+	{ 0x00f1e9, 0x0a5,  40, 0 }, //   63.4153 MHz
+	{ 0x010502, 0x0dc,  36, 0 }, //   68.4216 MHz
+	{ 0x011763, 0x02f,  35, 0 }, //   73.2396 MHz
+	{ 0x012811, 0x0a4,  32, 0 }, //   77.6120 MHz
+	{ 0x013ff2, 0x09d,  30, 0 }, //   83.8717 MHz
+	{ 0x015602, 0x027,  28, 0 }, //   89.6553 MHz
+	{ 0x0168aa, 0x0db,  27, 0 }, //   94.5459 MHz
+	{ 0x017d79, 0x02d,  25, 0 }, //  100.0008 MHz
+	{ 0x0194d4, 0x09c,  24, 0 }, //  106.1233 MHz
+	{ 0x01b8d0, 0x01f,  21, 0 }, //  115.5564 MHz
+	{ 0x01e3d1, 0x025,  20, 0 }, //  126.8296 MHz
+	{ 0x020a03, 0x09b,  18, 0 }, //  136.8422 MHz
+	{ 0x02476d, 0x024,  16, 0 }, //  152.9416 MHz
+	{ 0x027fe3, 0x01d,  15, 0 }, //  167.7425 MHz
+	{ 0x02ac04, 0x017,  14, 0 }, //  179.3106 MHz
+	{ 0x02faf1, 0x01c,  12, 0 }, //  200.0005 MHz
+	{ 0x0385a8, 0x015,  10, 0 }, //  236.3638 MHz
+	{ 0x041406, 0x01b,   9, 0 }, //  273.6845 MHz
+	{ 0x048eda, 0x014,   8, 0 }, //  305.8831 MHz
+	{ 0x052a6e, 0x007,   7, 0 }, //  346.6670 MHz
+	{ 0x05f5e1, 0x013,   6, 0 }, //  400.0000 MHz
+	{ 0x070b50, 0x005,   5, 0 }, //  472.7276 MHz
+	{ 0x089c0c, 0x004,   4, 0 }, //  577.7777 MHz
+	{ 0x0b11c7, 0x003,   3, 0 }, //  742.8577 MHz
+	{ 0x0f7f49, 0x002,   2, 0 }, // 1040.0000 MHz
+	{ 0x17d784, 0x000,   0, 0 }, // 1600.0000 MHz
+	{ 0x1dcd65, 0x001,   1, 1 }, // 2000.0000 MHz
+	{ 0x2faf08, 0x000,   0, 0 }, // 3200.0000 MHz
+#else
+	{ 0x000000, 0x000,   0, 0 }, //    0.0000 MHz
+	{ 0x004c4c, 0x12d, 100, 0 }, //   20.0008 MHz
+	{ 0x006e34, 0x125,  80, 0 }, //   28.8891 MHz
+	{ 0x007ffb, 0x0ed,  75, 0 }, //   33.5493 MHz
+	{ 0x008eb6, 0x124,  64, 0 }, //   37.4108 MHz
+	{ 0x009ff9, 0x0e5,  60, 0 }, //   41.9359 MHz
+	{ 0x00b455, 0x0ad,  50, 0 }, //   47.2730 MHz
+	{ 0x00ca6a, 0x0e4,  48, 0 }, //   53.0616 MHz
+	{ 0x00d54c, 0x0dd,  45, 0 }, //   55.9145 MHz
+	{ 0x00e95f, 0x0a5,  40, 0 }, //   61.1768 MHz
+	{ 0x010502, 0x0dc,  36, 0 }, //   68.4216 MHz
+	{ 0x0123b7, 0x0a4,  32, 0 }, //   76.4713 MHz
+	{ 0x013ff2, 0x09d,  30, 0 }, //   83.8717 MHz
+	{ 0x015c02, 0x0db,  27, 0 }, //   91.2282 MHz
+	{ 0x017d79, 0x02d,  25, 0 }, //  100.0008 MHz
+	{ 0x0194d4, 0x09c,  24, 0 }, //  106.1233 MHz
+	{ 0x01c2d4, 0x025,  20, 0 }, //  118.1819 MHz
+	{ 0x020a03, 0x09b,  18, 0 }, //  136.8422 MHz
+	{ 0x02476d, 0x024,  16, 0 }, //  152.9416 MHz
+	{ 0x027fe3, 0x01d,  15, 0 }, //  167.7425 MHz
+	{ 0x02deaf, 0x01c,  12, 0 }, //  192.5929 MHz
+	{ 0x0385a8, 0x015,  10, 0 }, //  236.3638 MHz
+	{ 0x041406, 0x01b,   9, 0 }, //  273.6845 MHz
+	{ 0x048eda, 0x014,   8, 0 }, //  305.8831 MHz
+	{ 0x0588e4, 0x013,   6, 0 }, //  371.4294 MHz
+	{ 0x070b50, 0x005,   5, 0 }, //  472.7276 MHz
+	{ 0x089c0c, 0x004,   4, 0 }, //  577.7777 MHz
+	{ 0x0b11c7, 0x003,   3, 0 }, //  742.8577 MHz
+	{ 0x0f7f49, 0x002,   2, 0 }, // 1040.0000 MHz
+	{ 0x17d784, 0x000,   0, 0 }, // 1600.0000 MHz
+	{ 0x1dcd65, 0x001,   1, 1 }, // 2000.0000 MHz
+	{ 0x2faf08, 0x000,   0, 0 }, // 3200.0000 MHz
+#endif
+};
+
+const unsigned freqplan_table_len =
+	sizeof(freqplan_table) / sizeof(freqplan_table[0]);
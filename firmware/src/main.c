@@ -27,6 +27,11 @@
 #include "dsp_driver.h"
 #include "power.h"
 #include "railtask.h"
+#include "ui_hw.h"
+#include "bootprof.h"
+#include "settings.h"
+#include "debugprint.h"
+#include "diagnostics.h"
 
 /* --------------------
  * Interrupt priorities
@@ -37,6 +42,7 @@
 
 #define IRQPRI_RAIL 3
 #define IRQPRI_SAMPLE_RATE_TIMER 3
+#define IRQPRI_UI 4
 
 
 /* ---------------------------------
@@ -44,13 +50,12 @@
  * ---------------------------------
  */
 
-#define NTASKS 5
+#define NTASKS 6
 TaskHandle_t taskhandles[NTASKS];
 
 void slow_dsp_task(void *);
 void misc_fast_task(void *);
 
-void debug_init(void);
 void slow_dsp_rtos_init(void);
 
 /* -------------
@@ -60,7 +65,9 @@ void slow_dsp_rtos_init(void);
  * before starting the RTOS scheduler.
  */
 int main(void) {
+	boot_profile_start();
 	CHIP_Init();
+	boot_milestone(BOOT_CHIP_INIT);
 	debug_init();
 	printf("Gekkokapula\n");
 
@@ -71,8 +78,7 @@ int main(void) {
 	GPIO_PinModeSet(TFT_EN_PORT, TFT_EN_PIN, gpioModePushPull, 0);
 
 	enter_DefaultMode_from_RESET();
-	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
-	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	boot_milestone(BOOT_CLOCKS);
 
 	NVIC_SetPriorityGrouping(0);
 	NVIC_SetPriority( FRC_PRI_IRQn, IRQPRI_RAIL);
@@ -85,7 +91,9 @@ int main(void) {
 	NVIC_SetPriority(PROTIMER_IRQn, IRQPRI_RAIL);
 	NVIC_SetPriority(   SYNTH_IRQn, IRQPRI_RAIL);
 	NVIC_SetPriority( RFSENSE_IRQn, IRQPRI_RAIL);
-	NVIC_SetPriority( WTIMER0_IRQn, IRQPRI_SAMPLE_RATE_TIMER);
+	NVIC_SetPriority(  TIMER1_IRQn, IRQPRI_SAMPLE_RATE_TIMER);
+	NVIC_SetPriority(GPIO_EVEN_IRQn, IRQPRI_UI);
+	NVIC_SetPriority( GPIO_ODD_IRQn, IRQPRI_UI);
 	{
 		LDMA_Init_t init = LDMA_INIT_DEFAULT;
 		LDMA_Init(&init);
@@ -102,13 +110,22 @@ int main(void) {
 	ui_rtos_init();
 	railtask_rtos_init();
 
+	// Restore settings before any task uses the parameters
+	settings_init();
+	ui_settings_restore();
+
 	xTaskCreate(misc_fast_task, "Misc", 0x100, NULL, 4, &taskhandles[3]);
-	xTaskCreate(display_task, "Display", 0x300, NULL, 2, &taskhandles[0]);
-	xTaskCreate(railtask_main, "RAIL", 0x300, NULL, 2, &taskhandles[1]);
+	// Display task starts at a higher priority so that display
+	// initialization delays overlap with radio initialization.
+	// It lowers its priority once the display is ready.
+	xTaskCreate(display_task, "Display", 0x300, NULL, 3, &taskhandles[0]);
+	xTaskCreate(railtask_main, "RAIL", 0x300, NULL, 3, &taskhandles[1]);
 	xTaskCreate(fast_dsp_task, "Fast DSP", 0x300, NULL, 4, &taskhandles[4]);
 	xTaskCreate(slow_dsp_task, "Slow DSP", 0x300, NULL, 2, &taskhandles[2]);
+	xTaskCreate(settings_task, "Settings", 0x100, NULL, 1, &taskhandles[5]);
 
 	printf("Starting scheduler\n");
+	boot_milestone(BOOT_SCHEDULER);
 	vTaskStartScheduler();
 	return 0;
 }
@@ -126,22 +143,20 @@ int main(void) {
  * - Reading user interface inputs
  * - Controlling display backlight brightness
  * - Monitoring other tasks
+ *
+ * Input edges wake up the task immediately through interrupts,
+ * so keying does not wait for the next polling round.
+ * When the user interface is idle, nothing needs to be done
+ * regularly, so the task only wakes up on input.
  */
 void misc_fast_task(void *arg) {
 	(void)arg;
+	ui_hw_init();
 	for(;;) {
 		ui_check_buttons();
 		ui_control_backlight();
-		int ti;
-		for(ti=0; ti<NTASKS; ti++) {
-#if 0
-			int v;
-			v = uxTaskGetStackHighWaterMark(taskhandles[ti]);
-			printf("%d:%4d | ", ti, v);
-			if(ti == NTASKS-1) printf("\n");
-#endif
-		}
-		vTaskDelay(10);
+		boot_profile_report();
+		ulTaskNotifyTake(pdTRUE, ui_is_idle() ? portMAX_DELAY : 10);
 	}
 }
 
@@ -185,14 +200,52 @@ void vApplicationMallocFailedHook()
 }
 
 
+/* Wait for an interrupt in idle times too short for tickless idle.
+ * The idle task checks for tickless idle after calling this,
+ * so the first call in each tick returns without waiting.
+ * Otherwise every longer idle time would first wait
+ * for the next tick before the tick is suppressed. */
 void vApplicationIdleHook()
 {
+	static TickType_t checked;
+	TickType_t now = xTaskGetTickCount();
+	if (now != checked) {
+		checked = now;
+		return;
+	}
+	diag.sleep_wfi++;
 	__DSB();
 	__WFI();
 	__ISB();
 }
 
 
+/* Tickless idle, counting sleeps and their length in diagnostics.
+ * Sleep is done by the SysTick based vPortSuppressTicksAndSleep
+ * of the port, which always stays in EM1. EM2 would stop both
+ * the SysTick and the HFXO which the radio needs while running,
+ * and the radio is never stopped. */
+static int idle_slept;
+
+void idle_sleep_enter(void)
+{
+	idle_slept = 1;
+}
+
+void idle_sleep(uint32_t expected_ticks)
+{
+	TickType_t start = xTaskGetTickCount();
+	idle_slept = 0;
+	vPortSuppressTicksAndSleep(expected_ticks);
+	if (idle_slept) {
+		diag.sleep_tickless++;
+		diag.sleep_ticks += xTaskGetTickCount() - start;
+	} else {
+		diag.sleep_aborted++;
+	}
+}
+
+
 void Default_Handler()
 {
 	/* Find the number of the current interrupt */
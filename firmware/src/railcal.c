@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "em_device.h"
+#include "em_emu.h"
+#include "em_msc.h"
+
+#include "rail.h"
+
+#include "rail_config.h"
+
+#include "railcal.h"
+#include "diagnostics.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+// Identifies a valid cache page. Change if the format changes.
+#define RAILCAL_MAGIC 0x6C61436CUL
+// Temperature change in degrees C which forces calibration again
+#define RAILCAL_TEMP_DELTA 20
+
+/* The cache uses the flash page before the settings pages,
+ * see settings.c, so erasing it does not erase anything else.
+ *
+ * Entries are appended to the page as new calibrations are done,
+ * so the page is only erased when it gets full.
+ * The latest entry for a divider is the valid one.
+ * Erased flash reads as all ones, so an unused entry
+ * has divider 0xFFFFFFFF. */
+struct railcal_entry {
+	uint32_t divider;
+	uint32_t image_rejection;
+	int32_t temperature;
+};
+
+/* The header identifies the radio configuration and RAIL library
+ * the values were calibrated with. If either has changed,
+ * the page is erased and the values are calibrated again. */
+struct railcal_header {
+	uint32_t magic;
+	uint32_t fingerprint;
+};
+
+#define RAILCAL_ENTRIES ((FLASH_PAGE_SIZE - sizeof(struct railcal_header)) / sizeof(struct railcal_entry))
+
+struct railcal_page {
+	struct railcal_header header;
+	struct railcal_entry entries[RAILCAL_ENTRIES];
+};
+
+#define RAILCAL_BASE (FLASH_BASE + FLASH_SIZE - 3 * FLASH_PAGE_SIZE)
+#define railcal_flash ((const struct railcal_page *)RAILCAL_BASE)
+
+extern char __etext, __data_start__, __data_end__;
+extern uint32_t generated[];
+
+struct railcal_state {
+	// 1 if the flash page is available for the cache
+	char ok;
+	// Number of used entries in flash
+	unsigned used;
+	// Temperature when the latest applied value was calibrated
+	int32_t temperature;
+};
+static struct railcal_state railcal;
+
+
+static int32_t railcal_temperature(void)
+{
+#if defined(_EMU_TEMP_TEMP_MASK)
+	return (int32_t)EMU_TemperatureGet();
+#else
+	// No temperature sensor reading available without the ADC,
+	// so values are never calculated again.
+	return 25;
+#endif
+}
+
+
+/* Hash of the RAIL library version and the radio configuration.
+ * The configuration is hashed before railtask modifies it for
+ * a divider. It contains a pointer, so relinking the firmware
+ * may also change the hash, which only costs calibrating again. */
+static uint32_t railcal_fingerprint(void)
+{
+	RAIL_Version_t v;
+	RAIL_GetVersion(&v, false);
+	uint32_t words[2] = {
+		v.hash,
+		(uint32_t)v.major << 24 | (uint32_t)v.minor << 16 | (uint32_t)v.rev << 8 | v.build
+	};
+	// FNV-1a over words instead of bytes
+	uint32_t h = 2166136261UL;
+	unsigned i;
+	for (i = 0; i < 2; i++)
+		h = (h ^ words[i]) * 16777619UL;
+	for (i = 0; generated[i] != 0xFFFFFFFFUL; i++)
+		h = (h ^ generated[i]) * 16777619UL;
+	return h;
+}
+
+
+void railcal_init(void)
+{
+	if (&__etext + (&__data_end__ - &__data_start__) > (char *)RAILCAL_BASE) {
+		printf("Firmware overlaps calibration cache, not using it\n");
+		return;
+	}
+	railcal.ok = 1;
+	const struct railcal_page *page = railcal_flash;
+	struct railcal_header header = { RAILCAL_MAGIC, railcal_fingerprint() };
+	MSC_Init();
+	unsigned i;
+	for (i = 0; i < RAILCAL_ENTRIES; i++) {
+		if (page->entries[i].divider == 0xFFFFFFFFUL)
+			break;
+	}
+	railcal.used = i;
+	// Start from an empty page if the page is not valid, it is
+	// from another radio configuration or it is full,
+	// so new values can be stored.
+	if (page->header.magic != header.magic
+		|| page->header.fingerprint != header.fingerprint
+		|| railcal.used >= RAILCAL_ENTRIES) {
+		printf("Erasing calibration cache\n");
+		MSC_ErasePage((uint32_t*)RAILCAL_BASE);
+		MSC_WriteWord((uint32_t*)RAILCAL_BASE, &header, sizeof(header));
+		railcal.used = 0;
+	}
+}
+
+
+static const struct railcal_entry *railcal_find(uint32_t divider)
+{
+	const struct railcal_entry *found = NULL;
+	unsigned i;
+	for (i = 0; i < railcal.used; i++) {
+		if (railcal_flash->entries[i].divider == divider)
+			found = &railcal_flash->entries[i];
+	}
+	return found;
+}
+
+
+static void railcal_store(uint32_t divider, uint32_t image_rejection, int32_t temperature)
+{
+	if (!railcal.ok || railcal.used >= RAILCAL_ENTRIES)
+		return;
+	struct railcal_entry e = { divider, image_rejection, temperature };
+	MSC_WriteWord((uint32_t*)&railcal_flash->entries[railcal.used], &e, sizeof(e));
+	railcal.used++;
+}
+
+
+void railcal_apply(RAIL_Handle_t rail, uint32_t divider)
+{
+	int32_t temperature = railcal_temperature();
+	const struct railcal_entry *e = railcal_find(divider);
+	if (e != NULL && abs(e->temperature - temperature) < RAILCAL_TEMP_DELTA) {
+		RAIL_ApplyIrCalibration(rail, e->image_rejection);
+		railcal.temperature = e->temperature;
+		++diag.cal_ir_cached;
+		return;
+	}
+	uint32_t image_rejection;
+	if (RAIL_CalibrateIr(rail, &image_rejection) == RAIL_STATUS_NO_ERROR) {
+		railcal_store(divider, image_rejection, temperature);
+		railcal.temperature = temperature;
+		++diag.cal_ir_runs;
+	}
+}
+
+
+void railcal_pending(RAIL_Handle_t rail, uint32_t divider)
+{
+	RAIL_CalMask_t pending = RAIL_GetPendingCal(rail);
+	if (pending & RAIL_CAL_TEMP_VCO) {
+		RAIL_CalibrateTemp(rail);
+		++diag.cal_temp_runs;
+		// Image rejection also drifts with temperature
+		if (abs(railcal_temperature() - railcal.temperature) >= RAILCAL_TEMP_DELTA)
+			pending |= RAIL_CAL_ONETIME_IRCAL;
+	}
+	if (pending & RAIL_CAL_ONETIME_IRCAL) {
+		RAIL_Idle(rail, RAIL_IDLE_ABORT, true);
+		railcal_apply(rail, divider);
+	}
+}
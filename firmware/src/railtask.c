@@ -11,8 +11,15 @@
 // rig
 #include "rig.h"
 #include "railtask.h"
+#include "ui.h"
 #include "dsp_driver.h"
+#include "dsp.h"
 #include "config.h"
+#include "diagnostics.h"
+#include "bootprof.h"
+#include "freqplan.h"
+#include "scan.h"
+#include "railcal.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -25,15 +32,39 @@
 // Define it separately instead of calculating from
 // CHANNELSPACING*MIDDLECHANNEL to reduce rounding error.
 #define MIDDLEFREQ 4688
+// Maximum receive frequency offset tuned digitally by DSP
+#define RX_FINETUNE_MAX 4000
 
 RAIL_Handle_t rail;
 xSemaphoreHandle railtask_sem;
 
+/* Synthesizer configuration for a frequency.
+ * Configurations for both receive and transmit are prepared
+ * before they are needed, so keying and unkeying only
+ * has to apply one. */
+struct railtask_plan {
+	uint32_t frequency;
+	const struct freqplan_range *range;
+	// Full configuration frequency the offset was computed from
+	uint32_t anchor;
+	// Synthesizer frequency offset, valid if fast is 1
+	RAIL_FrequencyOffset_t offset;
+	char fast;
+};
+
 struct railtask_state {
 	// Latest configured frequency
 	uint32_t frequency;
 	// 1 if frequency is within range that can be tuned
 	char config_ok;
+	// Frequency, divider register value and division ratio
+	// from the latest full configuration
+	uint32_t full_frequency, divider, ratio;
+	// Prepared receive and transmit configurations
+	struct railtask_plan plan_rx, plan_tx;
+	// Time of the latest key or unkey event
+	uint32_t key_cycles;
+	volatile char key_pending;
 };
 struct railtask_state railtask;
 
@@ -63,78 +94,64 @@ const RAIL_ChannelConfig_t channelConfig = {
 };
 
 
-/* Find suitable VCO frequency dividers for a given frequency.
- * Return 0 if no possible combination was found. */
-static inline uint32_t find_divider(uint32_t f, uint32_t *ratio)
+/* Prepare configuration for a frequency.
+ * A frequency can be tuned by only changing the synthesizer
+ * frequency offset relative to the frequency of the latest
+ * full configuration, if the divider stays the same and
+ * the offset fits in the range supported by RAIL.
+ * Nothing is recalculated if the plan is already up to date. */
+static void railtask_plan(struct railtask_plan *plan, uint32_t freq)
 {
-	// Shift all frequencies right by 10 so they fit in 32 bits
-	// even after multiplying by all possible divider values.
-	f >>= 10;
-	// Find divider values that get VCO frequency closest to
-	// the approximate middle of its tuning range, vco_mid.
-	const int32_t vco_mid = (int32_t)(2600000000UL >> 10);
-	// Smallest distance from vco_mid found.
-	// Initial value determines the maximum allowed distance + 1.
-	// If no divider values getting closer than that are found,
-	// d1m, d2m and d3m will stay 0 and the function will return 0.
-	int32_t dmin = (int32_t)(600000000UL >> 10) + 1;
-	// Divider values from the combination that achieves dmin.
-	uint32_t d1m = 0, d2m = 0, d3m = 0;
-	uint32_t d1, d2, d3;
-#ifdef KAPULA_v2
-	// Try all the possible combinations
-	for (d1 = 1; d1 <= 5; d1++) {
-#else
-	// v1 seems to crash on some frequencies below 23 MHz.
-	// It's mostly useless on lower frequencies anyway,
-	// so just limit the tuning range by not allowing d1=5.
-	for (d1 = 1; d1 <= 4; d1++) {
-#endif
-		for (d2 = 1; d2 <= 5; d2++) {
-#ifdef KAPULA_v2
-			// Try values 1, 2, 3, 4, 5, 7 for d3
-			for (d3 = 1; d3 <= 6; d3++) {
-				if (d3 == 6) d3 = 7;
-#else
-			// 7 isn't supported by the older chip.
-			for (d3 = 1; d3 <= 5; d3++) {
-#endif
-				// VCO frequency with these divider values
-				int32_t vco = (int32_t)f * d1 * d2 * d3;
-				// Distance from middle of VCO tuning range
-				int32_t d = abs(vco - vco_mid);
-				if (d < dmin) {
-					dmin = d;
-					d1m = d1;
-					d2m = d2;
-					d3m = d3;
-				}
-			}
-		}
-	}
-	*ratio = d1m * d2m * d3m;
-	if (d1m == 1) d1m = 0;
-	if (d2m == 1) d2m = 0;
-	return (d1m << 6) | (d2m << 3) | d3m;
+	if (plan->range != NULL && plan->frequency == freq
+		&& plan->anchor == railtask.full_frequency)
+		return;
+	plan->frequency = freq;
+	plan->range = freqplan_lookup(freq - MIDDLEFREQ);
+	plan->anchor = railtask.full_frequency;
+	plan->fast = 0;
+	if (!railtask.config_ok || plan->range->divider != railtask.divider)
+		return;
+	// Synthesizer resolution is 38.4 MHz / 2**19 / ratio.
+	// Round to the nearest step.
+	int64_t df = (int64_t)freq - (int64_t)railtask.full_frequency;
+	int64_t ticks = df * railtask.ratio * (1L<<19);
+	ticks = (ticks + (ticks >= 0 ? 19200000 : -19200000)) / 38400000;
+	if (ticks > RAIL_FREQUENCY_OFFSET_MAX || ticks < RAIL_FREQUENCY_OFFSET_MIN)
+		return;
+	plan->offset = (RAIL_FrequencyOffset_t)ticks;
+	plan->fast = 1;
 }
 
 
-void railtask_config_channel(uint32_t freq)
+static void railtask_config_channel(const struct railtask_plan *plan)
 {
 	unsigned r __attribute__((unused));
+	uint32_t freq = plan->frequency;
 	uint32_t basefreq = freq - MIDDLEFREQ;
-
-	uint32_t ratio;
-	uint32_t divider = find_divider(basefreq, &ratio);
+	uint32_t divider = plan->range->divider, ratio = plan->range->ratio;
 
 	RAIL_Idle(rail, RAIL_IDLE_ABORT, true);
 
+	// Retune by only changing the synthesizer frequency offset
+	// if the prepared plan allows that.
+	if (plan->fast && railtask.config_ok
+		&& RAIL_SetFreqOffset(rail, plan->offset) == RAIL_STATUS_NO_ERROR) {
+		railtask.frequency = freq;
+		++diag.retunes_fast;
+		return;
+	}
+
 	if (!divider) {
 		// This frequency isn't possible.
 		railtask.config_ok = 0;
 		return;
 	}
 	railtask.config_ok = 1;
+	railtask.full_frequency = freq;
+	railtask.divider = divider;
+	railtask.ratio = ratio;
+	++diag.retunes_full;
+	RAIL_SetFreqOffset(rail, 0);
 	// Modify the frequency divider register in radio configuration
 	generated[39] = divider;
 	// and the IF register.
@@ -155,6 +172,7 @@ void railtask_config_channel(uint32_t freq)
 	r = RAIL_ConfigChannels(rail, &channelConfig, NULL);
 	//printf("RAIL_ConfigChannels (2): %u\n", r);
 	railtask.frequency = freq;
+	railcal_apply(rail, divider);
 
 	// Make sure channel spacing is exactly the same with all dividers
 	// by setting SYNTH_CHSP register value here. RAIL calculates
@@ -168,7 +186,7 @@ void railtask_config_channel(uint32_t freq)
 
 	// 2.4 GHz needs different PA configuration
 	RAIL_TxPowerConfig_t txPowerConfig = {
-		.mode = divider == 1 ?
+		.mode = plan->range->pa_2g4 ?
 			RAIL_TX_POWER_MODE_2P4GIG_HP :
 			RAIL_TX_POWER_MODE_SUBGIG,
 		.voltage = 3300,
@@ -181,6 +199,20 @@ void railtask_config_channel(uint32_t freq)
 }
 
 
+int railtask_tunable(uint32_t freq)
+{
+	return freqplan_tunable(freq - MIDDLEFREQ);
+}
+
+
+void railtask_key_changed(uint32_t cycles)
+{
+	railtask.key_cycles = cycles;
+	railtask.key_pending = 1;
+	xSemaphoreGive(railtask_sem);
+}
+
+
 void rail_callback(RAIL_Handle_t rail, RAIL_Events_t events);
 
 static RAIL_Config_t railCfg = {
@@ -190,11 +222,14 @@ static RAIL_Config_t railCfg = {
 void railtask_init_radio(void)
 {
 	unsigned r;
+	railcal_init();
 	rail = RAIL_Init(&railCfg, NULL);
 	r = RAIL_ConfigCal(rail, RAIL_CAL_ALL);
 	printf("RAIL_ConfigCal: %u\n", r);
-	r = RAIL_ConfigEvents(rail, RAIL_EVENTS_ALL, RAIL_EVENT_RX_FIFO_ALMOST_FULL);
+	r = RAIL_ConfigEvents(rail, RAIL_EVENTS_ALL,
+		RAIL_EVENT_RX_FIFO_ALMOST_FULL | RAIL_EVENT_CAL_NEEDED);
 	printf("RAIL_ConfigEvents: %u\n", r);
+	boot_milestone(BOOT_RAIL_INIT);
 }
 
 
@@ -228,21 +263,59 @@ void railtask_main(void *arg)
 	(void)arg;
 	railtask_init_radio();
 	for(;;) {
+		if (railtask.config_ok)
+			railcal_pending(rail, railtask.divider);
+		scan_update();
+
+		char key_pending   = railtask.key_pending;
+		railtask.key_pending = 0;
 		bool keyed         = p.keyed;
 		enum rig_mode mode = p.mode;
 		uint32_t frequency = p.frequency;
 		int32_t split      = p.split_freq;
 		int32_t offset     = p.offset_freq;
 
-		if (keyed) {
-			frequency += split;
+		uint32_t tx_frequency = frequency + split;
+		if (mode >= MODE_USB && mode <= MODE_CWL) {
+			tx_frequency += offset;
+		}
+
+		/* In receive mode, a frequency close enough to the current
+		 * synthesizer frequency is tuned digitally by DSP.
+		 * The synthesizer is only retuned, exactly to the wanted
+		 * frequency, when it goes outside the fine tuning window.
+		 * This gives hysteresis, so tuning the knob around
+		 * a frequency does not keep retuning the synthesizer.
+		 * Band scope needs the synthesizer moved to each step, so
+		 * scan_tune skips the fine tuning window. */
+		int32_t finetune = 0;
+		if (!keyed && !scan_tune(&frequency) && railtask.config_ok) {
+			int32_t d = (int32_t)(frequency - railtask.frequency);
+			if (d >= -RX_FINETUNE_MAX && d <= RX_FINETUNE_MAX) {
+				finetune = d;
+				frequency = railtask.frequency;
+			}
 		}
-		if (keyed && mode >= MODE_USB && mode <= MODE_CWL) {
-			frequency += offset;
+		if (finetune != rs.rx_finetune) {
+			rs.rx_finetune = finetune;
+			dsp_update_params();
+			// Offset cursor moves
+			display_ev.text_changed = 1;
+			xSemaphoreGive(display_sem);
 		}
 
-		if (frequency != railtask.frequency) {
-			railtask_config_channel(frequency);
+		railtask_plan(&railtask.plan_tx, tx_frequency);
+		railtask_plan(&railtask.plan_rx, frequency);
+		const struct railtask_plan *plan =
+			keyed ? &railtask.plan_tx : &railtask.plan_rx;
+
+		// Time from the start of a retune to the radio running again
+		uint32_t retune_start = 0;
+		int retuned = 0;
+		if (plan->frequency != railtask.frequency) {
+			retune_start = DWT->CYCCNT;
+			retuned = 1;
+			railtask_config_channel(plan);
 		}
 
 		RAIL_RadioState_t rs = RAIL_GetRadioState(rail);
@@ -254,6 +327,8 @@ void railtask_main(void *arg)
 			&& tx_freq_allowed(railtask.frequency)
 		) {
 			start_tx_dsp(rail);
+			if (key_pending)
+				diag.ptt_tx_us = (uint64_t)(DWT->CYCCNT - railtask.key_cycles) * 10 / 384;
 		} else if ((!keyed)
 			&& ((rs & RAIL_RF_STATE_RX) == 0)
 			&& railtask.config_ok
@@ -261,8 +336,21 @@ void railtask_main(void *arg)
 			if (rs & RAIL_RF_STATE_TX)
 				RAIL_StopTxStream(rail);
 			start_rx_dsp(rail);
+			if (key_pending)
+				dsp_measure_rx_latency(railtask.key_cycles);
+		}
+		scan_tuned();
+		if (retuned) {
+			uint32_t us = (uint64_t)(DWT->CYCCNT - retune_start) * 10 / 384;
+			diag.retune_us = us;
+			if (us > diag.retune_us_max)
+				diag.retune_us_max = us;
 		}
-		xSemaphoreTake(railtask_sem, portMAX_DELAY);
+		// A full configuration changes the offsets,
+		// so prepare the other direction again.
+		railtask_plan(&railtask.plan_tx, tx_frequency);
+		railtask_plan(&railtask.plan_rx, frequency);
+		xSemaphoreTake(railtask_sem, scan_wait_time());
 	}
 }
 
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Recording of fast DSP inputs to RTT up-buffer 3.
+ * The hooks are in dsp.c and run in the fast DSP task,
+ * which is the only writer, so no locking is needed here. */
+
+#if RECORD
+
+#include "em_device.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "task.h"
+
+// rig
+#include "record.h"
+#include "debugprint.h"
+#include "diagnostics.h"
+
+#include <string.h>
+
+// Largest record, a received block of 64 samples
+#define RECORD_MAXLEN (sizeof(struct record_header) \
+	+ sizeof(struct record_block) + 64 * sizeof(iq_in_t))
+
+static struct {
+	// Cycle counter at the start of the current block
+	uint32_t block_start;
+	int started;
+	uint8_t buf[RECORD_MAXLEN];
+} rec;
+
+
+/* Write a record made of a fixed part and samples.
+ * Waits until the debugger has read enough to fit it whole. */
+static void record_write(uint8_t type, uint32_t cycles,
+	const void *head, unsigned head_len, const void *data, unsigned data_len)
+{
+	if (!rec.started) {
+		rec.started = 1;
+		struct record_start s = { RECORD_VERSION, sizeof(struct dsp_params) };
+		record_write(RECORD_START, cycles, &s, sizeof(s), NULL, 0);
+	}
+	unsigned len = head_len + data_len;
+	if (sizeof(struct record_header) + len > sizeof(rec.buf))
+		return;
+	struct record_header h = { RECORD_MAGIC, type, len, cycles };
+	memcpy(rec.buf, &h, sizeof(h));
+	if (head_len > 0)
+		memcpy(rec.buf + sizeof(h), head, head_len);
+	if (data_len > 0)
+		memcpy(rec.buf + sizeof(h) + head_len, data, data_len);
+	len += sizeof(h);
+
+	while (rtt_space(RTT_RECORD) < len) {
+		++diag.record_waits;
+		vTaskDelay(1);
+	}
+	rtt_write(RTT_RECORD, rec.buf, len);
+}
+
+
+void record_params(const struct dsp_params *params)
+{
+	record_write(RECORD_PARAMS, DWT->CYCCNT, params, sizeof(*params), NULL, 0);
+}
+
+
+void record_squelch_restart(void)
+{
+	record_write(RECORD_SQUELCH_RESTART, DWT->CYCCNT, NULL, 0, NULL, 0);
+}
+
+
+void record_begin(void)
+{
+	rec.block_start = DWT->CYCCNT;
+}
+
+
+void record_rx(const iq_in_t *in, unsigned in_len, const audio_out_t *out, unsigned out_len)
+{
+	struct record_block b = {
+		.cycles = DWT->CYCCNT - rec.block_start,
+		.out_hash = record_hash(out, out_len * sizeof(*out)),
+		.in_len = in_len,
+		.out_len = out_len,
+	};
+	record_write(RECORD_RX, rec.block_start, &b, sizeof(b), in, in_len * sizeof(*in));
+}
+
+
+void record_tx(const audio_in_t *in, const fm_out_t *out, unsigned len)
+{
+	struct record_block b = {
+		.cycles = DWT->CYCCNT - rec.block_start,
+		.out_hash = record_hash(out, len * sizeof(*out)),
+		.in_len = len,
+		.out_len = len,
+	};
+	record_write(RECORD_TX, rec.block_start, &b, sizeof(b), in, len * sizeof(*in));
+}
+
+#endif
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Channel scanner.
+ *
+ * Scanning steps p.frequency through a range of p.scan_span,
+ * starting from the frequency where scanning was started.
+ * After each step, the DSP measures squelch over a few blocks
+ * and wakes up the RAIL task when done, so the scanner dwells on
+ * a channel only as long as the measurement takes.
+ * Steps are tuned through the normal RAIL task path, so small
+ * steps use the fast retune or digital fine tuning instead of
+ * a full channel configuration.
+ *
+ * Memory scan mode steps through the frequencies stored
+ * in memory channels in the same way.
+ *
+ * When a signal is found, scanning stops on it and continues
+ * after the signal has been gone for SCAN_HANG_TIME.
+ *
+ * Band scope mode sweeps the synthesizer in SCOPE_STEPS steps
+ * over p.scan_span centered on p.frequency, without changing
+ * p.frequency. After each step is tuned, the DSP captures a short
+ * FFT and wakes up the RAIL task when done. The DSP stitches the
+ * steps into a line shown on the waterfall.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "em_device.h"
+
+#include "rig.h"
+#include "dsp.h"
+#include "railtask.h"
+#include "scan.h"
+#include "ui.h"
+#include "diagnostics.h"
+#include "settings.h"
+
+// Time to keep listening after a signal has disappeared
+#define SCAN_HANG_TIME pdMS_TO_TICKS(2000)
+// Interval to check whether the signal is still there
+#define SCAN_POLL_TIME pdMS_TO_TICKS(50)
+// Maximum time to wait for squelch measurement
+#define SCAN_SETTLE_TIMEOUT pdMS_TO_TICKS(100)
+
+enum scan_phase {
+	// Not scanning
+	SCAN_IDLE,
+	// Frequency changed, waiting for the radio to be tuned
+	SCAN_TUNING,
+	// Waiting for squelch measurement
+	SCAN_SETTLING,
+	// Stopped on a signal
+	SCAN_HOLD,
+	// Waiting for a band scope capture
+	SCAN_CAPTURING,
+};
+
+struct scan_state {
+	enum scan_phase phase;
+	// Mode the current phase belongs to
+	enum rig_scan mode;
+	// Start frequency of the range and current channel number
+	uint32_t start, channel;
+	// Cycle counter value at the start of the current step
+	uint32_t step_start;
+	// Tick count when the step was tuned or a signal last heard
+	TickType_t tick;
+	// Channels scanned since rate_start
+	TickType_t rate_start;
+	unsigned rate_count;
+	// Band scope step and cycle counter at the start of a sweep
+	unsigned step;
+	uint32_t sweep_start;
+};
+static struct scan_state scan;
+
+/* Get frequency of a channel to scan.
+ * Returns 0 if the channel is not used. */
+static uint32_t scan_channel_frequency(uint32_t channel)
+{
+	if (scan.mode == SCAN_MEM) {
+		uint32_t f;
+		if (settings_get(SETTING_CH(channel, SETTING_CH_FREQUENCY), &f))
+			return f;
+		return 0;
+	}
+	return scan.start + channel * p.scan_step;
+}
+
+static void scan_next(void)
+{
+	uint32_t n, i;
+	if (scan.mode == SCAN_MEM)
+		n = SETTINGS_CHANNELS;
+	else
+		n = p.scan_span / p.scan_step;
+	if (n < 1)
+		n = 1;
+	// Skip frequencies that cannot be tuned to
+	for (i = 0; i < n; i++) {
+		scan.channel = (scan.channel + 1) % n;
+		uint32_t f = scan_channel_frequency(scan.channel);
+		if (f != 0 && railtask_tunable(f)) {
+			p.frequency = f;
+			break;
+		}
+	}
+	scan.phase = SCAN_TUNING;
+	scan.step_start = DWT->CYCCNT;
+	scan.rate_count++;
+
+	display_ev.text_changed = 1;
+	xSemaphoreGive(display_sem);
+}
+
+static uint32_t scope_step_frequency(unsigned step)
+{
+	uint32_t step_hz = p.scan_span / SCOPE_STEPS;
+	return p.frequency - p.scan_span / 2 + step * step_hz + step_hz / 2;
+}
+
+static void scope_update(TickType_t now)
+{
+	switch (scan.phase) {
+	case SCAN_IDLE:
+		scan.step = 0;
+		scan.sweep_start = DWT->CYCCNT;
+		scan.phase = SCAN_TUNING;
+		break;
+	case SCAN_CAPTURING:
+		if (!dsp_scope_done() && now - scan.tick < SCAN_SETTLE_TIMEOUT)
+			break;
+		if (++scan.step >= SCOPE_STEPS) {
+			diag.scope_sweep_ms = (DWT->CYCCNT - scan.sweep_start) / 38400;
+			scan.sweep_start = DWT->CYCCNT;
+			scan.step = 0;
+		}
+		scan.phase = SCAN_TUNING;
+		break;
+	default:
+		break;
+	}
+}
+
+int scan_tune(uint32_t *frequency)
+{
+	if (scan.mode != SCAN_SCOPE || scan.phase == SCAN_IDLE)
+		return 0;
+	*frequency = scope_step_frequency(scan.step);
+	return 1;
+}
+
+void scan_update(void)
+{
+	if (p.scan == SCAN_OFF || p.keyed || p.scan != scan.mode) {
+		scan.phase = SCAN_IDLE;
+		scan.mode = p.keyed ? SCAN_OFF : p.scan;
+		if (scan.mode == SCAN_OFF)
+			return;
+	}
+	TickType_t now = xTaskGetTickCount();
+	if (scan.mode == SCAN_SCOPE) {
+		scope_update(now);
+		return;
+	}
+	switch (scan.phase) {
+	case SCAN_IDLE:
+		scan.start = p.frequency;
+		scan.channel = 0;
+		scan.phase = SCAN_TUNING;
+		scan.step_start = DWT->CYCCNT;
+		scan.rate_start = now;
+		scan.rate_count = 0;
+		if (scan.mode == SCAN_MEM) {
+			// Start from the first stored channel
+			scan.channel = SETTINGS_CHANNELS - 1;
+			scan_next();
+		}
+		break;
+	case SCAN_TUNING:
+		break;
+	case SCAN_SETTLING:
+		if (dsp_squelch_settled()) {
+			diag.scan_settle_us = (uint64_t)(DWT->CYCCNT - scan.step_start) * 10 / 384;
+			if (dsp_signal_present()) {
+				scan.phase = SCAN_HOLD;
+				scan.tick = now;
+			} else {
+				scan_next();
+			}
+		} else if (now - scan.tick >= SCAN_SETTLE_TIMEOUT) {
+			// Radio is probably not receiving, so move on
+			scan_next();
+		}
+		break;
+	case SCAN_HOLD:
+		if (dsp_signal_present())
+			scan.tick = now;
+		else if (now - scan.tick >= SCAN_HANG_TIME)
+			scan_next();
+		break;
+	default:
+		break;
+	}
+
+	TickType_t elapsed = now - scan.rate_start;
+	if (elapsed >= pdMS_TO_TICKS(1000)) {
+		diag.scan_channels_per_s = scan.rate_count * configTICK_RATE_HZ / elapsed;
+		scan.rate_start = now;
+		scan.rate_count = 0;
+	}
+}
+
+void scan_tuned(void)
+{
+	if (scan.phase != SCAN_TUNING)
+		return;
+	scan.tick = xTaskGetTickCount();
+	if (scan.mode == SCAN_SCOPE) {
+		scan.phase = SCAN_CAPTURING;
+		if (railtask_tunable(scope_step_frequency(scan.step)))
+			dsp_scope_capture(scan.step);
+		else
+			dsp_scope_skip(scan.step);
+		return;
+	}
+	dsp_squelch_restart();
+	scan.phase = SCAN_SETTLING;
+}
+
+TickType_t scan_wait_time(void)
+{
+	switch (scan.phase) {
+	case SCAN_TUNING:
+		return 0;
+	case SCAN_SETTLING:
+	case SCAN_CAPTURING:
+		return SCAN_SETTLE_TIMEOUT;
+	case SCAN_HOLD:
+		return SCAN_POLL_TIME;
+	default:
+		return portMAX_DELAY;
+	}
+}
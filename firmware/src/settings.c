@@ -0,0 +1,268 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Settings store in flash.
+ *
+ * The last two flash pages are used as a log of records.
+ * One page is active at a time and new records are appended to it,
+ * so writing a setting does not need an erase. The latest record
+ * of a key is the valid one. When the active page gets full, the
+ * latest values are copied to the other page, which becomes active.
+ * The header of a page contains a sequence number to find the
+ * active one and it is written last, so a copy interrupted by power
+ * loss leaves the previous page active.
+ *
+ * Erasing a page stops execution from flash for tens of
+ * milliseconds, which would interrupt receive audio, so pages are
+ * only erased at boot and before turning off. The page to copy to
+ * is erased at boot. If it gets used up and the active page gets
+ * full again, changes are only kept in RAM until turning off.
+ *
+ * Writing a record only stalls flash access for the time of
+ * writing two words. The writes are still done in a low priority
+ * task after changes have settled, so that tuning around does not
+ * write the same settings over and over again.
+ */
+
+#include "em_device.h"
+#include "em_msc.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "settings.h"
+#include "rig.h"
+#include "ui.h"
+
+#include <stdio.h>
+
+// Time a change has to stay the same before writing it
+#define SETTINGS_DEBOUNCE_TIME pdMS_TO_TICKS(3000)
+// Interval of checking for changes
+#define SETTINGS_POLL_TIME pdMS_TO_TICKS(200)
+
+#define SETTINGS_MAGIC 0x5E77U
+
+/* The key part is in the second word and it is written last,
+ * so a record with a partially written value is not valid. */
+struct settings_record {
+	uint32_t value;
+	uint16_t key;
+	// Inverse of key
+	uint16_t check;
+};
+
+#define SETTINGS_RECORDS (FLASH_PAGE_SIZE / sizeof(struct settings_record))
+
+/* The first record of a page is the header. Its value is the
+ * sequence number and key is SETTINGS_MAGIC. */
+struct settings_page {
+	struct settings_record r[SETTINGS_RECORDS];
+};
+
+#define SETTINGS_BASE (FLASH_BASE + FLASH_SIZE - 2 * FLASH_PAGE_SIZE)
+#define settings_flash ((struct settings_page *)SETTINGS_BASE)
+
+extern char __etext, __data_start__, __data_end__;
+
+struct settings_state {
+	uint32_t value[SETTINGS_N];
+	// 1 if a setting has a value
+	uint8_t stored[SETTINGS_N];
+	// 1 if a setting has changed since it was written
+	uint8_t dirty[SETTINGS_N];
+	// Active page, its sequence number and next free record
+	unsigned page, sequence, next;
+	// 1 if the other page is erased
+	char spare_erased;
+	// 1 if flash is available for settings
+	char ok;
+	// Tick count of the latest change
+	TickType_t changed;
+	// Settings are changed from the misc task and the settings task
+	SemaphoreHandle_t lock;
+};
+static struct settings_state settings;
+
+
+static int record_valid(const struct settings_record *r)
+{
+	return (uint16_t)(r->key ^ r->check) == 0xFFFFU;
+}
+
+static int record_erased(const struct settings_record *r)
+{
+	const uint32_t *w = (const uint32_t *)r;
+	return w[0] == 0xFFFFFFFFUL && w[1] == 0xFFFFFFFFUL;
+}
+
+static int page_erased(unsigned page)
+{
+	unsigned i;
+	for (i = 0; i < SETTINGS_RECORDS; i++) {
+		if (!record_erased(&settings_flash[page].r[i]))
+			return 0;
+	}
+	return 1;
+}
+
+static int page_valid(unsigned page)
+{
+	const struct settings_record *h = &settings_flash[page].r[0];
+	return record_valid(h) && h->key == SETTINGS_MAGIC;
+}
+
+static void write_record(unsigned page, unsigned i, unsigned key, uint32_t value)
+{
+	struct settings_record r = { value, key, key ^ 0xFFFFU };
+	MSC_WriteWord((uint32_t *)&settings_flash[page].r[i], &r, sizeof(r));
+}
+
+/* Copy the latest values into the erased spare page
+ * and make it the active page. */
+static int settings_compact(void)
+{
+	if (!settings.spare_erased)
+		return 0;
+	unsigned page = settings.page ^ 1, i = 1, key;
+	for (key = 0; key < SETTINGS_N; key++) {
+		if (settings.stored[key]) {
+			write_record(page, i++, key, settings.value[key]);
+			settings.dirty[key] = 0;
+		}
+	}
+	settings.sequence++;
+	write_record(page, 0, SETTINGS_MAGIC, settings.sequence);
+	settings.page = page;
+	settings.next = i;
+	settings.spare_erased = 0;
+	return 1;
+}
+
+/* Append changed settings to the active page.
+ * Returns 0 if there was no room for them. */
+static int settings_write(void)
+{
+	unsigned key;
+	for (key = 0; key < SETTINGS_N; key++) {
+		if (!settings.dirty[key])
+			continue;
+		if (settings.next >= SETTINGS_RECORDS)
+			return settings_compact();
+		settings.dirty[key] = 0;
+		write_record(settings.page, settings.next++, key, settings.value[key]);
+	}
+	return 1;
+}
+
+
+void settings_init(void)
+{
+	settings.lock = xSemaphoreCreateMutex();
+	if (&__etext + (&__data_end__ - &__data_start__) > (char *)SETTINGS_BASE) {
+		printf("Firmware overlaps settings, not using them\n");
+		return;
+	}
+	MSC_Init();
+	settings.ok = 1;
+
+	// Find the active page
+	int valid0 = page_valid(0), valid1 = page_valid(1);
+	if (valid0 && valid1) {
+		int32_t d = settings_flash[1].r[0].value - settings_flash[0].r[0].value;
+		settings.page = d > 0;
+	} else if (valid0 || valid1) {
+		settings.page = valid1;
+	} else {
+		// Start a new log
+		if (!page_erased(0))
+			MSC_ErasePage((uint32_t *)&settings_flash[0]);
+		write_record(0, 0, SETTINGS_MAGIC, 0);
+		settings.page = 0;
+	}
+	settings.sequence = settings_flash[settings.page].r[0].value;
+
+	// Replay the log
+	unsigned i;
+	for (i = 1; i < SETTINGS_RECORDS; i++) {
+		const struct settings_record *r = &settings_flash[settings.page].r[i];
+		if (record_erased(r))
+			break;
+		if (record_valid(r) && r->key < SETTINGS_N) {
+			settings.value[r->key] = r->value;
+			settings.stored[r->key] = 1;
+		}
+	}
+	settings.next = i;
+
+	unsigned spare = settings.page ^ 1;
+	if (!page_erased(spare))
+		MSC_ErasePage((uint32_t *)&settings_flash[spare]);
+	settings.spare_erased = 1;
+}
+
+
+int settings_get(unsigned key, uint32_t *value)
+{
+	if (key >= SETTINGS_N)
+		return 0;
+	xSemaphoreTake(settings.lock, portMAX_DELAY);
+	int stored = settings.stored[key];
+	if (stored)
+		*value = settings.value[key];
+	xSemaphoreGive(settings.lock);
+	return stored;
+}
+
+
+void settings_set(unsigned key, uint32_t value)
+{
+	if (key >= SETTINGS_N)
+		return;
+	xSemaphoreTake(settings.lock, portMAX_DELAY);
+	if (!settings.stored[key] || settings.value[key] != value) {
+		settings.value[key] = value;
+		settings.stored[key] = 1;
+		settings.dirty[key] = 1;
+		settings.changed = xTaskGetTickCount();
+	}
+	xSemaphoreGive(settings.lock);
+}
+
+
+void settings_flush(void)
+{
+	if (!settings.ok)
+		return;
+	ui_settings_capture();
+	xSemaphoreTake(settings.lock, portMAX_DELAY);
+	if (!settings_write()) {
+		// Both pages are used up. Erase the spare page
+		// since turning off anyway.
+		MSC_ErasePage((uint32_t *)&settings_flash[settings.page ^ 1]);
+		settings.spare_erased = 1;
+		settings_compact();
+	}
+	xSemaphoreGive(settings.lock);
+}
+
+
+void settings_task(void *arg)
+{
+	(void)arg;
+	for (;;) {
+		vTaskDelay(SETTINGS_POLL_TIME);
+		if (!settings.ok)
+			continue;
+		ui_settings_capture();
+		// Write only when the user has stopped changing things
+		// and the radio is not transmitting.
+		if (xTaskGetTickCount() - settings.changed < SETTINGS_DEBOUNCE_TIME
+			|| p.keyed)
+			continue;
+		xSemaphoreTake(settings.lock, portMAX_DELAY);
+		settings_write();
+		xSemaphoreGive(settings.lock);
+	}
+}
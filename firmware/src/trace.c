@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: MIT */
+
+/* Binary RTOS trace written to RTT up-buffer 1.
+ * The hooks are defined in FreeRTOSConfig.h. */
+
+#if TRACE
+
+#include "em_device.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+
+// rig
+#include "trace.h"
+#include "debugprint.h"
+#include "diagnostics.h"
+
+#include <string.h>
+
+volatile uint32_t trace_isrs = TRACE_ISRS_DEFAULT;
+
+static struct {
+	// Records dropped since the last TRACE_DROPPED record
+	unsigned dropped;
+	// Queue numbers given so far
+	unsigned queues;
+} trace;
+
+
+/* Write a record and a name after it.
+ * Interrupts calling FreeRTOS are masked, so records are written
+ * in the order of their timestamps. */
+void trace_name(uint8_t type, uint8_t id, uint16_t arg, const char *name)
+{
+	struct trace_record r[1 + (configMAX_TASK_NAME_LEN + sizeof(struct trace_record) - 1) / sizeof(struct trace_record)];
+	unsigned len = sizeof(r[0]);
+	if (name != NULL) {
+		if (arg > configMAX_TASK_NAME_LEN)
+			arg = configMAX_TASK_NAME_LEN;
+		memset(&r[1], 0, sizeof(r) - sizeof(r[0]));
+		memcpy(&r[1], name, arg);
+		len += (arg + sizeof(r[0]) - 1) & ~(sizeof(r[0]) - 1);
+	}
+
+	UBaseType_t s = portSET_INTERRUPT_MASK_FROM_ISR();
+	r[0] = (struct trace_record){ DWT->CYCCNT, type, id, arg };
+	if (trace.dropped > 0) {
+		struct trace_record d = { r[0].cycles, TRACE_DROPPED, 0,
+			trace.dropped > 0xFFFF ? 0xFFFF : trace.dropped };
+		if (rtt_write(RTT_TRACE, &d, sizeof(d)))
+			trace.dropped = 0;
+	}
+	if (trace.dropped > 0 || !rtt_write(RTT_TRACE, r, len)) {
+		++trace.dropped;
+		++diag.trace_dropped;
+	}
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(s);
+}
+
+
+void trace_event(uint8_t type, uint8_t id, uint16_t arg)
+{
+	trace_name(type, id, arg, NULL);
+}
+
+
+/* Number a new queue so that sends can be told apart.
+ * Returns the number to store in the queue. */
+unsigned trace_queue_create(uint8_t queue_type)
+{
+	unsigned n = ++trace.queues;
+	trace_event(TRACE_QUEUE_CREATE, n, queue_type);
+	return n;
+}
+
+#endif
@@ -14,11 +14,15 @@
 #include "power.h"
 #include "railtask.h"
 #include "config.h"
+#include "diagnostics.h"
+#include "bootprof.h"
+#include "settings.h"
 
 #include "font8x8_basic.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <math.h>
 
@@ -32,6 +36,9 @@ rig_parameters_t p = {
 	.waterfall_averages = 20,
 	.squelch = 15,
 	.ctcss = 0.0f,
+	.scan = SCAN_OFF,
+	.scan_step = 12500,
+	.scan_span = 1000000,
 };
 rig_status_t rs = {0};
 
@@ -61,6 +68,14 @@ enum ui_field_name {
 	UI_FIELD_SPLIT0,
 	UI_FIELD_SPLIT1,
 
+	// Fields at the end of the second row
+	// and on the third row, common for all views
+
+	UI_FIELD_MEM,
+	UI_FIELD_SCAN,
+	UI_FIELD_SCAN_STEP,
+	UI_FIELD_SCAN_SPAN,
+
 	// FM specific fields
 
 	UI_FIELD_SQ, // Squelch
@@ -73,6 +88,9 @@ enum ui_field_name {
 	UI_FIELD_FT1,
 	UI_FIELD_FT2,
 	UI_FIELD_FT3,
+
+	// Diagnostics view page
+	UI_FIELD_DIAG_PAGE,
 };
 
 struct ui_field {
@@ -86,6 +104,9 @@ struct ui_view {
 	size_t n;
 	// Function to format text for the view
 	int (*text)(char*, size_t);
+	// 1 if the function formats the whole text
+	// instead of the text after common fields
+	char whole_text;
 	// Array of fields
 	struct ui_field fields[];
 };
@@ -102,8 +123,22 @@ struct ui_state {
 	unsigned char cursor;
 	unsigned char keyed;
 	unsigned char button_prev, ptt_prev, keyed_prev;
+	// Tick count when the button was pressed, and 1 if the
+	// press has been used to move the cursor or for a long press
+	TickType_t press_start;
+	unsigned char press_used;
+	// 1 if the diagnostics view is shown, the page shown,
+	// and the cursor of the normal view to return to
+	unsigned char diag, diag_page, diag_cursor;
 	// Index to ctcss_freqs
 	unsigned char ctcss;
+	// Indexes to ui_scan_steps and ui_scan_spans
+	unsigned char scan_step, scan_span;
+	// Selected memory channel
+	unsigned char memory;
+	// X coordinate of the offset frequency cursor on the display,
+	// -1 if it has not been drawn yet
+	int offset_cursor_x;
 	char text[TEXT_LEN+1];
 	unsigned char color[TEXT_LEN+1];
 	char textprev[TEXT_LEN+1];
@@ -134,6 +169,43 @@ struct ui_state ui;
 
 #define UI_FIELDS_COMMON_N 16
 
+// Memory channel field at the end of the second row and fields
+// on the third row are put after the view specific fields
+// so that the cursor moves through fields in the order shown.
+#define UI_FIELDS_ROW2 \
+	{ UI_FIELD_MEM,      31,31, 2, "Memory channel"   },\
+	{ UI_FIELD_SCAN,     32,36, 3, "Scan/band scope"  },\
+	{ UI_FIELD_SCAN_STEP,38,42, 2, "Scan step"        },\
+	{ UI_FIELD_SCAN_SPAN,44,47, 3, "Scan span"        }
+
+#define UI_FIELDS_ROW2_N 4
+
+static const char *const p_scan_names[] = { "off", "scan", "scope", "mem" };
+
+struct ui_scan_choice {
+	uint32_t hz;
+	const char *name;
+};
+
+static const struct ui_scan_choice ui_scan_steps[] = {
+	{   5000, "   5k" },
+	{   6250, "6.25k" },
+	{  10000, "  10k" },
+	{  12500, "12.5k" },
+	{  25000, "  25k" },
+	{ 100000, " 100k" },
+};
+
+static const struct ui_scan_choice ui_scan_spans[] = {
+	{   100000, "100k" },
+	{   250000, "250k" },
+	{   500000, "500k" },
+	{  1000000, "  1M" },
+	{  2000000, "  2M" },
+	{  5000000, "  5M" },
+	{ 10000000, " 10M" },
+};
+
 static const char *const p_mode_names[] = {
 	"---", " FM", " AM", "USB", "LSB", "CWU", "CWL", "---", "off"
 };
@@ -160,6 +232,17 @@ static int ui_view_common_text(char *text, size_t maxlen)
 	);
 };
 
+// Format text on the third row
+static int ui_row2_text(char *text, size_t maxlen)
+{
+	return snprintf(text, maxlen,
+		"%-5s %5s %4s",
+		p_scan_names[p.scan],
+		ui_scan_steps[ui.scan_step].name,
+		ui_scan_spans[ui.scan_span].name
+	);
+}
+
 // Format text specific to FM view
 static int ui_view_fm_text(char *text, size_t maxlen)
 {
@@ -179,12 +262,14 @@ static int ui_view_fm_text(char *text, size_t maxlen)
 };
 
 const struct ui_view ui_view_fm = {
-	UI_FIELDS_COMMON_N + 2,
+	UI_FIELDS_COMMON_N + 2 + UI_FIELDS_ROW2_N,
 	ui_view_fm_text,
+	0,
 	{
 	UI_FIELDS_COMMON,
 	{ UI_FIELD_SQ,       24,25, 2, "Squelch"          },
 	{ UI_FIELD_CTCSS,    26,30, 3, "CTCSS Hz"         },
+	UI_FIELDS_ROW2
 	}
 };
 
@@ -198,14 +283,16 @@ static int ui_view_ssb_text(char *text, size_t maxlen)
 };
 
 const struct ui_view ui_view_ssb = {
-	UI_FIELDS_COMMON_N + 4,
+	UI_FIELDS_COMMON_N + 4 + UI_FIELDS_ROW2_N,
 	ui_view_ssb_text,
+	0,
 	{
 	UI_FIELDS_COMMON,
 	{ UI_FIELD_FT0,      24,25, 2, "SSB finetune kHz" },
 	{ UI_FIELD_FT1,      26,26, 2, "Finetune 100 Hz"  },
 	{ UI_FIELD_FT2,      27,27, 2, "Finetune 10 Hz"   },
 	{ UI_FIELD_FT3,      28,28, 2, "SSB finetune Hz"  },
+	UI_FIELDS_ROW2
 	}
 };
 
@@ -217,31 +304,255 @@ static int ui_view_other_text(char *text, size_t maxlen)
 }
 
 const struct ui_view ui_view_other = {
-	UI_FIELDS_COMMON_N,
+	UI_FIELDS_COMMON_N + UI_FIELDS_ROW2_N,
 	ui_view_other_text,
+	0,
+	{
+	UI_FIELDS_COMMON,
+	UI_FIELDS_ROW2
+	}
+};
+
+/* Diagnostics view.
+ * Holding the encoder button down without turning toggles it,
+ * so numbers needed for tuning can be read without a debugger.
+ * Turning the knob changes the page. The numbers are sampled
+ * once a second in the misc task, and the text renderer
+ * only redraws the characters that change. */
+enum ui_diag_page {
+	UI_DIAG_CPU,    // CPU use of tasks and interrupts in percent
+	UI_DIAG_STACK,  // Stack never used by each task in words
+	UI_DIAG_BUF,    // Fast DSP queue high-water marks and overflows
+	UI_DIAG_WF,     // Waterfall line rate and drops, DSP CPU use
+	UI_DIAG_LAT,    // Keying and retuning latencies
+	UI_DIAG_SLEEP,  // Idle wakeups and time in tickless sleep
+	UI_DIAG_PAGES
+};
+
+/* Most tasks shown. If there are more, uxTaskGetSystemState
+ * returns none of them and the task pages show the count instead. */
+#define UI_DIAG_TASKS 8
+#define UI_DIAG_PERIOD pdMS_TO_TICKS(1000)
+#define UI_LONG_PRESS pdMS_TO_TICKS(1000)
+
+struct ui_diag_task {
+	char name[5];
+	uint8_t cpu;
+	uint16_t stack;
+	uint8_t idle;
+};
+
+struct ui_diag {
+	// Values at the previous sample
+	TickType_t time;
+	uint32_t run_total, cycles_isr, wf_drawn, wf_dropped;
+	uint32_t sleep_wakeups, sleep_ticks;
+	uint32_t run[UI_DIAG_TASKS];
+	TaskStatus_t status[UI_DIAG_TASKS];
+
+	// Values shown
+	struct ui_diag_task tasks[UI_DIAG_TASKS];
+	unsigned n_tasks;
+	// Number of tasks if there were too many to show, otherwise 0
+	unsigned tasks_cut;
+	uint8_t isr;
+	// Waterfall lines drawn per 10 seconds and dropped per second
+	uint16_t wf_lines_10s, wf_drops;
+	// Idle wakeups per second and percentage of time in tickless sleep
+	uint16_t sleep_wakeups_s;
+	uint8_t sleep_pct;
+};
+static struct ui_diag ui_diag;
+
+/* Format exactly len characters of the diagnostics view,
+ * cutting or padding with spaces. */
+static void ui_diag_put(char *dst, unsigned len, const char *fmt, ...)
+{
+	char buf[17];
+	va_list ap;
+	va_start(ap, fmt);
+	int r = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (r < 0)
+		r = 0;
+	if ((unsigned)r > len)
+		r = len;
+	memcpy(dst, buf, r);
+	memset(dst + r, ' ', len - r);
+}
+
+/* Format two tasks per row on the rows after the first one,
+ * showing the CPU use or stack of each. */
+static void ui_diag_task_rows(char *text, int stack)
+{
+	const struct ui_diag *d = &ui_diag;
+	unsigned i, k = 0;
+	char *row = text + 16;
+	if (d->tasks_cut) {
+		ui_diag_put(row, 16, "%u tasks, max %u", d->tasks_cut, UI_DIAG_TASKS);
+		return;
+	}
+	for (i = 0; i < d->n_tasks && row < text + TEXT_LEN; i++) {
+		const struct ui_diag_task *t = &d->tasks[i];
+		if (t->idle)
+			continue;
+		unsigned v = stack ? t->stack : t->cpu;
+		if (v > 999)
+			v = 999;
+		ui_diag_put(row + 8 * k, 8, "%-4s%3u", t->name, v);
+		if (++k == 2) {
+			k = 0;
+			row += 16;
+		}
+	}
+}
+
+static int ui_view_diag_text(char *text, size_t maxlen)
+{
+	const struct ui_diag *d = &ui_diag;
+	if (maxlen < TEXT_LEN + 1)
+		return 0;
+	memset(text, ' ', TEXT_LEN);
+	text[TEXT_LEN] = '\0';
+	unsigned i, idle = 0;
+	for (i = 0; i < d->n_tasks; i++) {
+		if (d->tasks[i].idle)
+			idle = d->tasks[i].cpu;
+	}
+	switch (ui.diag_page) {
+	case UI_DIAG_CPU:
+		ui_diag_put(text, 16, "CPU%% ISR%2u ID%3u", d->isr > 99 ? 99 : d->isr, idle);
+		ui_diag_task_rows(text, 0);
+		break;
+	case UI_DIAG_STACK:
+		ui_diag_put(text, 16, "STK free words");
+		ui_diag_task_rows(text, 1);
+		break;
+	case UI_DIAG_BUF:
+		ui_diag_put(text,      16, "BUF qRX%2u qTX%2u",
+			(unsigned)diag.rx_queue_max, (unsigned)diag.tx_queue_max);
+		ui_diag_put(text + 16, 16, "RX ovf %9u", (unsigned)diag.rx_blocks_overflow);
+		ui_diag_put(text + 32, 16, "RX und %9u", (unsigned)diag.rx_rail_underruns);
+		ui_diag_put(text + 48, 16, "TX ovf %9u", (unsigned)diag.tx_blocks_overflow);
+		break;
+	case UI_DIAG_WF:
+		ui_diag_put(text,      16, "WF  %3u.%u l/s",
+			d->wf_lines_10s / 10, d->wf_lines_10s % 10);
+		ui_diag_put(text + 16, 16, "drop/s %9u", d->wf_drops);
+		ui_diag_put(text + 32, 16, "dropped%9u", (unsigned)diag.waterfall_lines_dropped);
+		ui_diag_put(text + 48, 16, "DSP%3u%% WF%3u%%",
+			(unsigned)(diag.dsp_cpu_use * 100.0f),
+			(unsigned)(diag.waterfall_cpu_use * 100.0f));
+		break;
+	case UI_DIAG_LAT:
+		ui_diag_put(text,      16, "LAT us");
+		ui_diag_put(text + 16, 16, "PTT->TX %8u", (unsigned)diag.ptt_tx_us);
+		ui_diag_put(text + 32, 16, "unkey RX%8u", (unsigned)diag.unkey_rx_us);
+		ui_diag_put(text + 48, 16, "retune  %8u", (unsigned)diag.retune_us_max);
+		break;
+	case UI_DIAG_SLEEP:
+		ui_diag_put(text,      16, "SLP wake/s %5u", d->sleep_wakeups_s);
+		ui_diag_put(text + 16, 16, "tickless %6u%%", d->sleep_pct);
+		ui_diag_put(text + 32, 16, "slept ms%8u", (unsigned)diag.sleep_ticks);
+		ui_diag_put(text + 48, 16, "aborted %8u", (unsigned)diag.sleep_aborted);
+		break;
+	default:
+		break;
+	}
+	return TEXT_LEN;
+}
+
+const struct ui_view ui_view_diag = {
+	1,
+	ui_view_diag_text,
+	1,
 	{
-	UI_FIELDS_COMMON
+	{ UI_FIELD_DIAG_PAGE, 0, 3, 3, "Page"             },
 	}
 };
 
+/* Sample task run times and other counters for the diagnostics view.
+ * Called from the misc task while the view is shown.
+ * Run times count CPU cycles, so they include interrupts
+ * which happened while a task ran. */
+static void ui_diag_sample(void)
+{
+	struct ui_diag *d = &ui_diag;
+	TickType_t now = xTaskGetTickCount(), ticks = now - d->time;
+	if (ticks < UI_DIAG_PERIOD)
+		return;
+
+	uint32_t total;
+	unsigned n = uxTaskGetSystemState(d->status, UI_DIAG_TASKS, &total);
+	// Too many tasks: none are returned and neither is the total
+	d->tasks_cut = 0;
+	if (n == 0) {
+		d->tasks_cut = uxTaskGetNumberOfTasks();
+		total = portGET_RUN_TIME_COUNTER_VALUE();
+	}
+	uint32_t cycles = total - d->run_total;
+	uint32_t isr = diag.cycles_isr - d->cycles_isr;
+	uint32_t drawn = diag.waterfall_lines_drawn - d->wf_drawn;
+	uint32_t dropped = diag.waterfall_lines_dropped - d->wf_dropped;
+	uint32_t wakeups = diag.sleep_tickless + diag.sleep_wfi - d->sleep_wakeups;
+	uint32_t slept = diag.sleep_ticks - d->sleep_ticks;
+	unsigned i, k;
+
+	// Show tasks in the order they were created
+	for (i = 1; i < n; i++) {
+		TaskStatus_t s = d->status[i];
+		for (k = i; k > 0 && d->status[k-1].xTaskNumber > s.xTaskNumber; k--)
+			d->status[k] = d->status[k-1];
+		d->status[k] = s;
+	}
+	for (i = 0; i < n; i++) {
+		const TaskStatus_t *s = &d->status[i];
+		struct ui_diag_task *t = &d->tasks[i];
+		unsigned num = s->xTaskNumber % UI_DIAG_TASKS;
+		snprintf(t->name, sizeof(t->name), "%s", s->pcTaskName);
+		t->stack = s->usStackHighWaterMark;
+		t->idle = s->uxBasePriority == tskIDLE_PRIORITY;
+		t->cpu = cycles ? (uint64_t)(s->ulRunTimeCounter - d->run[num]) * 100 / cycles : 0;
+		d->run[num] = s->ulRunTimeCounter;
+	}
+	d->n_tasks = n;
+	d->isr = cycles ? (uint64_t)isr * 100 / cycles : 0;
+	d->wf_lines_10s = drawn * 10 * configTICK_RATE_HZ / ticks;
+	d->wf_drops = dropped * configTICK_RATE_HZ / ticks;
+	d->sleep_wakeups_s = wakeups * configTICK_RATE_HZ / ticks;
+	d->sleep_pct = slept * 100 / ticks;
+
+	d->time = now;
+	d->run_total = total;
+	d->cycles_isr += isr;
+	d->wf_drawn += drawn;
+	d->wf_dropped += dropped;
+	d->sleep_wakeups += wakeups;
+	d->sleep_ticks += slept;
+
+	display_ev.text_changed = 1;
+	xSemaphoreGive(display_sem);
+}
+
 struct ui_state ui = {
 	.view = &ui_view_fm,
 	.cursor = 6,
+	.offset_cursor_x = -1,
+	.scan_step = 3,
+	.scan_span = 3,
 };
 
 #define BACKLIGHT_ON_TIME 2000
 #define BACKLIGHT_DIM_LEVEL 50
 
-#define DISPLAYBUF_SIZE 384
-#define DISPLAYBUF2_SIZE 384
-uint8_t displaybuf[DISPLAYBUF_SIZE], displaybuf2[DISPLAYBUF2_SIZE];
-
 volatile struct display_ev display_ev;
 SemaphoreHandle_t display_sem;
 
-#if DISPLAYBUF_SIZE < 3*8*8
+#if DISPLAY_BUF_SIZE < 3*8*8
 #error "Too small display buffer for text"
 #endif
+// Maximum number of characters in a run drawn at once
+#define TEXT_RUN_MAX (DISPLAY_BUF_SIZE / (3*8*8))
 
 // Wrap number between 0 and b-1
 static int wrap(int a, int b)
@@ -271,22 +582,65 @@ const struct ui_text_color ui_text_colors[] = {
 	{ 0x00, 0x00, 0x00,  0xFF, 0xFF, 0xFF },
 	{ 0x80, 0xFF, 0x80,  0x60, 0x60, 0xC0 },
 	{ 0x80, 0xFF, 0x80,  0x00, 0x00, 0x80 },
+	// Frequency that cannot be tuned to
+	{ 0xFF, 0x60, 0x60,  0x40, 0x40, 0x40 },
+};
+#define UI_COLOR_UNTUNABLE 4
+
+#define GLYPH_BYTES (3*8*8)
+// 16 glyphs take about 3 kB of RAM
+#define GLYPH_CACHE_N 16
+
+/* Cache of glyphs already expanded into display pixel format.
+ * An entry is identified by the character and its color.
+ * On a miss, the least recently used entry is replaced. */
+struct glyph_cache_entry {
+	unsigned char c, color;
+	// Value of glyph_cache.time when last used, 0 if unused
+	uint32_t used;
+	uint8_t pixels[GLYPH_BYTES];
 };
 
-void ui_character(int x1, int y1, unsigned char c, unsigned char color)
+struct glyph_cache {
+	uint32_t time;
+	struct glyph_cache_entry e[GLYPH_CACHE_N];
+};
+static struct glyph_cache glyph_cache;
+
+/* A glyph sent directly from the cache may still be in flight
+ * while the glyphs of the next run are looked up, so the cache
+ * must be larger than a run to avoid replacing it. */
+#if GLYPH_CACHE_N <= TEXT_RUN_MAX
+#error "Glyph cache should be larger than a text run"
+#endif
+
+/* Get the pixel data of a glyph, expanding it into the cache
+ * if it is not there yet. */
+static const uint8_t *ui_glyph(unsigned char c, unsigned char color)
 {
+	struct glyph_cache *g = &glyph_cache;
+	struct glyph_cache_entry *e, *lru = &g->e[0];
+	unsigned n;
 	int x, y;
-	if(!display_ready()) return;
 
-	struct ui_text_color colors = ui_text_colors[color];
-	if (c > 0x80)
-		c = 0;
-	const char *font = font8x8_basic[c];
+	g->time++;
+	for (n = 0; n < GLYPH_CACHE_N; n++) {
+		e = &g->e[n];
+		if (e->used && e->c == c && e->color == color) {
+			e->used = g->time;
+			++diag.glyph_cache_hits;
+			return e->pixels;
+		}
+		if (e->used < lru->used)
+			lru = e;
+	}
+	++diag.glyph_cache_misses;
 
-	display_area(x1, y1, x1+7, y1+7);
-	display_start();
+	struct ui_text_color colors = ui_text_colors[color];
+	// Characters outside the font are drawn blank
+	const char *font = font8x8_basic[c >= 0x80 ? 0 : c];
 
-	uint8_t *bufp = displaybuf;
+	uint8_t *bufp = lru->pixels;
 	for (y=0; y<8; y++) {
 		for (x=0; x<8; x++) {
 			if (font[y] & (1<<x)) {
@@ -300,18 +654,56 @@ void ui_character(int x1, int y1, unsigned char c, unsigned char color)
 			}
 		}
 	}
-	display_transfer(displaybuf, 3*8*8);
+	lru->c = c;
+	lru->color = color;
+	lru->used = g->time;
+	return lru->pixels;
 }
 
-void ui_update_text(void)
+// Y coordinates of the text rows on the display
+static const uint8_t ui_text_rows[TEXT_LEN / 16] = { 0, 8, 16, 160-8 };
+
+/* Draw n characters of ui.text starting from position i.
+ * The characters must be on the same row, so they form
+ * a single display window and are sent in one DMA transfer.
+ * A single character is sent directly from the glyph cache. */
+static void ui_text_run(unsigned i, unsigned n)
+{
+	const uint8_t *glyphs[TEXT_RUN_MAX];
+	int y;
+	unsigned k;
+	if(!display_ready()) return;
+
+	int x1 = (i % 16) * 8, y1 = ui_text_rows[i / 16];
+
+	for (k=0; k<n; k++)
+		glyphs[k] = ui_glyph(ui.text[i+k], ui.color[i+k]);
+
+	if (n == 1) {
+		display_window(x1, y1, x1+7, y1+7, glyphs[0], GLYPH_BYTES);
+		return;
+	}
+
+	// Pixels go row by row through the whole window,
+	// so the 8 pixel rows of each glyph are interleaved.
+	uint8_t *buf = display_buffer(), *bufp = buf;
+	for (y=0; y<8; y++) {
+		for (k=0; k<n; k++) {
+			memcpy(bufp, glyphs[k] + y * (GLYPH_BYTES/8), GLYPH_BYTES/8);
+			bufp += GLYPH_BYTES/8;
+		}
+	}
+	display_window(x1, y1, x1+8*n-1, y1+7, buf, GLYPH_BYTES*n);
+}
+
+/* Format the text of a view made of the common fields,
+ * the fields of the view and the tip of the selected field. */
+static void ui_fields_text(const struct ui_view *view, unsigned cursor)
 {
 	int r;
 	// TODO: put signal strength back somewhere
 	//int s_dB = 10.0*log10(rs.smeter);
 
-	unsigned cursor = ui.cursor;
-	const struct ui_view *view = ui.view;
-
 	char *textbegin = ui.text;
 	char *text = textbegin;
 	size_t maxlen = TEXT_LEN + 1;
@@ -324,6 +716,15 @@ void ui_update_text(void)
 	text += r;
 	maxlen -= r;
 
+	for (; text < textbegin + 31; text++, maxlen--)
+		*text = ' ';
+	*text++ = "0123456789ABCDEF"[ui.memory % 16];
+	maxlen--;
+
+	r = ui_row2_text(text, maxlen);
+	text += r;
+	maxlen -= r;
+
 	// Fill the rest with spaces
 	for (; text < textbegin + 48; text++, maxlen--)
 		*text = ' ';
@@ -337,6 +738,17 @@ void ui_update_text(void)
 
 	for (; maxlen > 0; text++, maxlen--)
 		*text = ' ';
+}
+
+void ui_update_text(void)
+{
+	unsigned cursor = ui.cursor;
+	const struct ui_view *view = ui.view;
+
+	if (view->whole_text)
+		view->text(ui.text, TEXT_LEN + 1);
+	else
+		ui_fields_text(view, cursor);
 
 	size_t n, i;
 	for (i = 0; i < TEXT_LEN; i++) {
@@ -355,10 +767,20 @@ void ui_update_text(void)
 		for (i = pos1; i <= pos2; i++)
 			ui.color[i] = c;
 	}
+	if (!view->whole_text && !railtask_tunable(p.frequency)) {
+		for (i = 0; i < 10; i++) {
+			if (ui.color[i] != 1)
+				ui.color[i] = UI_COLOR_UNTUNABLE;
+		}
+	}
 }
 
 static void ui_choose_view(void)
 {
+	if (ui.diag) {
+		ui.view = &ui_view_diag;
+		return;
+	}
 	switch (p.mode) {
 	case MODE_FM:
 		ui.view = &ui_view_fm;
@@ -374,15 +796,89 @@ static void ui_choose_view(void)
 	}
 }
 
+void ui_settings_capture(void)
+{
+	settings_set(SETTING_CHANNEL,   ui.memory);
+	settings_set(SETTING_VOLUME,    p.volume);
+	settings_set(SETTING_WATERFALL, p.waterfall_averages);
+	settings_set(SETTING_SQUELCH,   p.squelch);
+	settings_set(SETTING_SCAN_STEP, ui.scan_step);
+	settings_set(SETTING_SCAN_SPAN, ui.scan_span);
+}
+
+/* Store parameters into the selected memory channel.
+ * Called when the user edits a parameter of the channel,
+ * so switching through empty channels does not fill them. */
+static void ui_settings_store_channel(void)
+{
+	unsigned ch = ui.memory;
+	// Scanning would overwrite the frequency of the memory channel
+	if (p.scan == SCAN_OFF)
+		settings_set(SETTING_CH(ch, SETTING_CH_FREQUENCY), p.frequency);
+	settings_set(SETTING_CH(ch, SETTING_CH_MODE),   p.mode);
+	settings_set(SETTING_CH(ch, SETTING_CH_SPLIT),  p.split_freq);
+	settings_set(SETTING_CH(ch, SETTING_CH_OFFSET), p.offset_freq);
+	settings_set(SETTING_CH(ch, SETTING_CH_CTCSS),  ui.ctcss);
+}
+
+/* Set parameters from the settings of a memory channel.
+ * Parameters of a channel not stored yet are kept as they are. */
+static void ui_settings_load_channel(unsigned ch)
+{
+	uint32_t v;
+	if (settings_get(SETTING_CH(ch, SETTING_CH_FREQUENCY), &v))
+		p.frequency = v;
+	if (settings_get(SETTING_CH(ch, SETTING_CH_MODE), &v) && v < MODE_OFF)
+		p.mode = v;
+	if (settings_get(SETTING_CH(ch, SETTING_CH_SPLIT), &v))
+		p.split_freq = v;
+	if (settings_get(SETTING_CH(ch, SETTING_CH_OFFSET), &v))
+		p.offset_freq = v;
+	if (settings_get(SETTING_CH(ch, SETTING_CH_CTCSS), &v)
+		&& v < sizeof(ctcss_freqs) / sizeof(ctcss_freqs[0])) {
+		ui.ctcss = v;
+		p.ctcss = 0.1f * (float)ctcss_freqs[ui.ctcss];
+	}
+	ui_choose_view();
+}
+
+void ui_settings_restore(void)
+{
+	uint32_t v;
+	if (settings_get(SETTING_CHANNEL, &v) && v < SETTINGS_CHANNELS)
+		ui.memory = v;
+	if (settings_get(SETTING_VOLUME, &v))
+		p.volume = v;
+	if (settings_get(SETTING_WATERFALL, &v))
+		p.waterfall_averages = v;
+	if (settings_get(SETTING_SQUELCH, &v))
+		p.squelch = v;
+	if (settings_get(SETTING_SCAN_STEP, &v)
+		&& v < sizeof(ui_scan_steps) / sizeof(ui_scan_steps[0])) {
+		ui.scan_step = v;
+		p.scan_step = ui_scan_steps[v].hz;
+	}
+	if (settings_get(SETTING_SCAN_SPAN, &v)
+		&& v < sizeof(ui_scan_spans) / sizeof(ui_scan_spans[0])) {
+		ui.scan_span = v;
+		p.scan_span = ui_scan_spans[v].hz;
+	}
+	ui_settings_load_channel(ui.memory);
+}
+
 static const int ui_steps[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
 static void ui_knob_turned(enum ui_field_name f, int diff)
 {
 	if (/*f >= UI_FIELD_FREQ0 && */f <= UI_FIELD_FREQ9) {
+		// Tuning by hand stops scanning
+		p.scan = SCAN_OFF;
 		p.frequency += diff * ui_steps[UI_FIELD_FREQ9 - f];
+		ui_settings_store_channel();
 		xSemaphoreGive(railtask_sem);
 	}
 	else if (f == UI_FIELD_MODE) {
 		p.mode = wrap(p.mode + diff, sizeof(p_mode_names) / sizeof(p_mode_names[0]));
+		ui_settings_store_channel();
 		dsp_update_params();
 		ui_choose_view();
 	}
@@ -403,6 +899,7 @@ static void ui_knob_turned(enum ui_field_name f, int diff)
 			step * diff,
 			100000000
 		);
+		ui_settings_store_channel();
 		xSemaphoreGive(railtask_sem);
 	}
 	else if (f == UI_FIELD_SQ) {
@@ -412,7 +909,30 @@ static void ui_knob_turned(enum ui_field_name f, int diff)
 	else if (f == UI_FIELD_CTCSS) {
 		ui.ctcss = wrap(ui.ctcss + diff, sizeof(ctcss_freqs) / sizeof(ctcss_freqs[0]));
 		p.ctcss = 0.1f * (float)ctcss_freqs[ui.ctcss];
+		ui_settings_store_channel();
+		dsp_update_params();
+	}
+	else if (f == UI_FIELD_MEM) {
+		// Edits were already stored in the previous channel,
+		// so just switch to the parameters of the new channel.
+		p.scan = SCAN_OFF;
+		ui.memory = wrap(ui.memory + diff, SETTINGS_CHANNELS);
+		settings_set(SETTING_CHANNEL, ui.memory);
+		ui_settings_load_channel(ui.memory);
 		dsp_update_params();
+		xSemaphoreGive(railtask_sem);
+	}
+	else if (f == UI_FIELD_SCAN) {
+		p.scan = wrap(p.scan + diff, sizeof(p_scan_names) / sizeof(p_scan_names[0]));
+		xSemaphoreGive(railtask_sem);
+	}
+	else if (f == UI_FIELD_SCAN_STEP) {
+		ui.scan_step = wrap(ui.scan_step + diff, sizeof(ui_scan_steps) / sizeof(ui_scan_steps[0]));
+		p.scan_step = ui_scan_steps[ui.scan_step].hz;
+	}
+	else if (f == UI_FIELD_SCAN_SPAN) {
+		ui.scan_span = wrap(ui.scan_span + diff, sizeof(ui_scan_spans) / sizeof(ui_scan_spans[0]));
+		p.scan_span = ui_scan_spans[ui.scan_span].hz;
 	}
 	else if (f >= UI_FIELD_FT0 && f <= UI_FIELD_FT3) {
 		p.offset_freq = wrap_signed(
@@ -420,8 +940,28 @@ static void ui_knob_turned(enum ui_field_name f, int diff)
 			ui_steps[UI_FIELD_FT3 - f] * diff,
 			6000
 		);
+		ui_settings_store_channel();
 		dsp_update_params();
 	}
+	else if (f == UI_FIELD_DIAG_PAGE) {
+		ui.diag_page = wrap(ui.diag_page + diff, UI_DIAG_PAGES);
+	}
+}
+
+/* Switch between the diagnostics view and the normal view,
+ * keeping the cursor of the normal view. */
+static void ui_toggle_diag(void)
+{
+	ui.diag = !ui.diag;
+	if (ui.diag) {
+		ui.diag_cursor = ui.cursor;
+		ui.cursor = 0;
+	} else {
+		ui.cursor = ui.diag_cursor;
+	}
+	ui_choose_view();
+	display_ev.text_changed = 1;
+	xSemaphoreGive(display_sem);
 }
 
 // count only every 4th position
@@ -440,11 +980,16 @@ void ui_check_buttons(void)
 
 	if (p.mode == MODE_OFF && ui.button_prev && (!button)) {
 		// Shut down after button has been released.
+		settings_flush();
 		shutdown();
 	}
 
 	const struct ui_view *view = ui.view;
 
+	if (button && !ui.button_prev) {
+		ui.press_start = xTaskGetTickCount();
+		ui.press_used = 0;
+	}
 	if (button)
 		ui.backlight_timer = 0;
 	if (pos_diff) {
@@ -455,6 +1000,7 @@ void ui_check_buttons(void)
 
 		if (button) {
 			ui.cursor = wrap(ui.cursor + pos_diff, view->n);
+			ui.press_used = 1;
 		} else {
 			size_t c = ui.cursor;
 			if (c < view->n) {
@@ -470,8 +1016,12 @@ void ui_check_buttons(void)
 			p.keyed = 0;
 			ui.keyed = 0;
 		}
-		if (p.keyed != ui.keyed_prev)
-			xSemaphoreGive(railtask_sem);
+		if (p.keyed != ui.keyed_prev) {
+			// Measure keying latency from the PTT edge
+			// or from now if keyed from the knob.
+			railtask_key_changed(ptt != ui.ptt_prev ?
+				ptt_edge_cycles : DWT->CYCCNT);
+		}
 		ui.keyed_prev = p.keyed;
 
 
@@ -481,6 +1031,15 @@ void ui_check_buttons(void)
 		xSemaphoreGive(display_sem);
 	}
 
+	// Long press without turning
+	if (button && !ui.press_used
+		&& xTaskGetTickCount() - ui.press_start >= UI_LONG_PRESS) {
+		ui.press_used = 1;
+		ui_toggle_diag();
+	}
+	if (ui.diag)
+		ui_diag_sample();
+
 	ui.pos_prev = pos_now;
 	ui.ptt_prev = ptt;
 	ui.button_prev = button;
@@ -496,32 +1055,90 @@ void ui_control_backlight(void)
 	}
 }
 
+int ui_is_idle(void)
+{
+	// The diagnostics view needs regular updates
+	return !ui.diag && ui.backlight_timer > BACKLIGHT_ON_TIME;
+}
+
 
 int fftrow = FFT_ROW2;
-#if DISPLAYBUF2_SIZE < 3*(FFT_BIN2-FFT_BIN1)
+#if DISPLAY_BUF_SIZE < WATERFALL_LINE_BYTES
 #error "Too small display buffer for FFT"
 #endif
+// Maximum number of waterfall lines drawn at once
+#define WATERFALL_BATCH_MAX (DISPLAY_BUF_SIZE / WATERFALL_LINE_BYTES)
+
+/* Waterfall line ring.
+ * The slow DSP task only advances head
+ * and the display task only advances tail,
+ * so no locking is needed. */
+struct waterfall_ring {
+	volatile unsigned head, tail;
+	uint8_t lines[WATERFALL_RING_LEN][WATERFALL_LINE_BYTES];
+};
+static struct waterfall_ring wf_ring;
 
-/* Check for the waterfall line flag and draw the line.
- * If the flag is not set, just return. */
-static void ui_display_waterfall(void)
+uint8_t *ui_waterfall_line_begin(void)
 {
-	if (!display_ev.waterfall_line)
-		return;
-	display_ev.waterfall_line = 0;
-	if (!display_ready()) {
-		printf("Bug? Display not ready in waterfall\n");
-		return;
+	struct waterfall_ring *r = &wf_ring;
+	if (r->head - r->tail >= WATERFALL_RING_LEN) {
+		++diag.waterfall_lines_dropped;
+		return NULL;
 	}
-	display_scroll(fftrow);
-	display_area(0,fftrow, FFT_BIN2-FFT_BIN1, fftrow);
-	display_start();
-	display_transfer(displaybuf2, 3*(FFT_BIN2-FFT_BIN1));
+	return r->lines[r->head % WATERFALL_RING_LEN];
+}
 
-	fftrow--;
-	if(fftrow < FFT_ROW1) fftrow = FFT_ROW2;
+void ui_waterfall_line_done(void)
+{
+	// Make sure the line is written before it is published
+	__DMB();
+	wf_ring.head++;
+	xSemaphoreGive(display_sem);
 }
 
+/* Draw the waterfall lines waiting in the ring.
+ * Consecutive lines are drawn with one window and one scroll.
+ * Each new line goes to the row above the previous one,
+ * so the newest line in a batch is at the top of the window.
+ * If the ring is empty, just return. */
+static void ui_display_waterfall(void)
+{
+	struct waterfall_ring *r = &wf_ring;
+	unsigned n, k;
+	while ((n = r->head - r->tail) > 0) {
+		if (!display_ready()) {
+			printf("Bug? Display not ready in waterfall\n");
+			return;
+		}
+		// Do not wrap around in the middle of a window
+		if (n > (unsigned)(fftrow - FFT_ROW1 + 1))
+			n = fftrow - FFT_ROW1 + 1;
+		if (n > WATERFALL_BATCH_MAX)
+			n = WATERFALL_BATCH_MAX;
+
+		uint8_t *buf = display_buffer();
+		for (k = 0; k < n; k++) {
+			memcpy(buf + k * WATERFALL_LINE_BYTES,
+				r->lines[(r->tail + n - 1 - k) % WATERFALL_RING_LEN],
+				WATERFALL_LINE_BYTES);
+		}
+		r->tail += n;
+		diag.waterfall_lines_drawn += n;
+
+		int top = fftrow - n + 1;
+		display_window(0, top, FFT_BIN2-FFT_BIN1-1, fftrow, buf, n * WATERFALL_LINE_BYTES);
+		display_scroll(top);
+
+		fftrow -= n;
+		if(fftrow < FFT_ROW1) fftrow = FFT_ROW2;
+	}
+}
+
+
+#if DISPLAY_BUF_SIZE < 128*3*3
+#error "Too small display buffer for offset cursor"
+#endif
 
 static const uint8_t offset_cursor_data[3*9] = {
 	255,255,  0,  255,255,  0,  255,255,  0,
@@ -529,55 +1146,78 @@ static const uint8_t offset_cursor_data[3*9] = {
 	  0,  0,  0,    0,255,255,    0,  0,  0
 };
 
-/* Draw the offset frequency cursor above waterfall */
+/* Draw the offset frequency cursor above waterfall.
+ * Only the old and new cursor positions are redrawn,
+ * and nothing is done if the cursor has not moved. */
 void ui_display_offset_cursor(void)
 {
-	display_area(0, 24, 127, 26);
-	display_start();
-	// First 33*8 bytes of font data is zeros
-	int i;
-	for (i = 0; i < 128 * 3 * 3 / (8*16); i++)
-		display_transfer((const uint8_t*)font8x8_basic[0], 8*16);
-
 	// Calculate the position based on sample rate and FFT size
-	int x = 64 + p.offset_freq * 256 / (RX_IQ_FS/2);
+	int x = 64 + (p.offset_freq + rs.rx_finetune) * 256 / (RX_IQ_FS/2);
 	if (x < 1) x = 1;
 	if (x > 127) x = 127;
-	display_area(x-1, 24, x+1, 26);
-	display_start();
-	display_transfer(offset_cursor_data, 3*9);
+
+	int x_prev = ui.offset_cursor_x;
+	if (x == x_prev)
+		return;
+	if (!display_ready())
+		return;
+
+	if (x_prev < 0) {
+		// Clear the whole area when drawing the first time
+		uint8_t *buf = display_buffer();
+		memset(buf, 0, 128*3*3);
+		display_window(0, 24, 127, 26, buf, 128*3*3);
+	} else {
+		// First 33*8 bytes of font data is zeros
+		display_window(x_prev-1, 24, x_prev+1, 26, (const uint8_t*)font8x8_basic[0], 3*9);
+	}
+
+	display_window(x-1, 24, x+1, 26, offset_cursor_data, 3*9);
+	ui.offset_cursor_x = x;
 }
 
 
+static inline int ui_text_changed(unsigned i)
+{
+	return ui.text[i] != ui.textprev[i] || ui.color[i] != ui.colorprev[i];
+}
+
 /* Update text on the display.
+ *
+ * Update only the characters that have changed.
+ * Adjacent changed characters on the same row are merged
+ * into one run which is drawn using a single display window
+ * and DMA transfer, since setting the window and waiting
+ * for the transfer to finish costs more than the pixels
+ * of a single character.
  *
  * To make both the text and the waterfall respond fast
- * for smooth user experience, draw the text one character
- * at a time and check for a possible new waterfall line
- * in between drawing each character.
- * Also update only the characters that have changed. */
+ * for smooth user experience, check for a possible new
+ * waterfall line in between drawing each run. */
 static void ui_display_text(void)
 {
 	ui_update_text();
-	int i;
-	for (i = 0; i < TEXT_LEN; i++) {
-		char c = ui.text[i],  cp = ui.textprev[i];
-		unsigned char v = ui.color[i], vp = ui.colorprev[i];
-		if (c != cp || v != vp) {
-			if (i < 16) // first line
-				ui_character(i*8, 0, c, v);
-			else if (i < 32) // second line
-				ui_character((i-16)*8, 8, c, v);
-			else if(i < 48) // third line
-				ui_character((i-32)*8, 16, c, v);
-			else // bottom line
-				ui_character((i-48)*8, 160-8, c, v);
-
-			ui.textprev[i] = c;
-			ui.colorprev[i] = v;
-
-			ui_display_waterfall();
+	unsigned i = 0, k;
+	while (i < TEXT_LEN) {
+		if (!ui_text_changed(i)) {
+			i++;
+			continue;
 		}
+		unsigned n = 1;
+		while (n < TEXT_RUN_MAX
+			&& (i + n) % 16 != 0
+			&& ui_text_changed(i + n))
+			n++;
+
+		ui_text_run(i, n);
+
+		for (k = i; k < i + n; k++) {
+			ui.textprev[k] = ui.text[k];
+			ui.colorprev[k] = ui.color[k];
+		}
+		i += n;
+
+		ui_display_waterfall();
 	}
 	ui_display_offset_cursor();
 }
@@ -587,6 +1227,8 @@ void display_task(void *arg)
 {
 	(void)arg;
 	display_init();
+	boot_milestone(BOOT_DISPLAY_READY);
+	vTaskPrioritySet(NULL, 2);
 	for (;;) {
 		xSemaphoreTake(display_sem, portMAX_DELAY);
 		ui_display_waterfall();
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * ui_hw.c
+ * Interrupts for user interface inputs
+ */
+
+#include "ui_hw.h"
+#include "trace.h"
+#include "diagnostics.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Task woken up by input interrupts
+static TaskHandle_t ui_hw_task;
+
+volatile uint32_t ptt_edge_cycles;
+
+static void ui_hw_gpio_irq(void)
+{
+	BaseType_t yield = 0;
+	diag_isr_enter();
+	TRACE_ISR_ENTER(TRACE_ISR_UI_GPIO);
+	uint32_t flags = GPIO_IntGetEnabled();
+	GPIO_IntClear(flags);
+	if (flags & (1UL << PTT_PIN))
+		ptt_edge_cycles = DWT->CYCCNT;
+	if (flags)
+		vTaskNotifyGiveFromISR(ui_hw_task, &yield);
+	TRACE_ISR_EXIT(TRACE_ISR_UI_GPIO);
+	diag_isr_exit();
+	portYIELD_FROM_ISR(yield);
+}
+
+void GPIO_EVEN_IRQHandler(void)
+{
+	ui_hw_gpio_irq();
+}
+
+void GPIO_ODD_IRQHandler(void)
+{
+	ui_hw_gpio_irq();
+}
+
+void ui_hw_init(void)
+{
+	ui_hw_task = xTaskGetCurrentTaskHandle();
+	// Interrupt on both edges of inputs.
+	// Encoder is counted by PCNT0, so the interrupts
+	// only tell that the count may have changed.
+	GPIO_ExtIntConfig(PTT_PORT,  PTT_PIN,  PTT_PIN,  true, true, true);
+	GPIO_ExtIntConfig(ENCP_PORT, ENCP_PIN, ENCP_PIN, true, true, true);
+	GPIO_ExtIntConfig(ENC1_PORT, ENC1_PIN, ENC1_PIN, true, true, true);
+	GPIO_ExtIntConfig(ENC2_PORT, ENC2_PIN, ENC2_PIN, true, true, true);
+	NVIC_ClearPendingIRQ(GPIO_EVEN_IRQn);
+	NVIC_ClearPendingIRQ(GPIO_ODD_IRQn);
+	NVIC_EnableIRQ(GPIO_EVEN_IRQn);
+	NVIC_EnableIRQ(GPIO_ODD_IRQn);
+}
@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: MIT */
+/* Replay a recording of fast DSP inputs, see inc/record.h.
+ *
+ * Every recorded block is processed again by dsp.c and
+ * its output is compared with the hash recorded on the device.
+ * The cycles each block took on the device and the time it
+ * takes on the host are summarized, and written for every
+ * block with -p, so that a recording can be used
+ * as a repeatable benchmark.
+ *
+ * Usage:
+ *     dsp_replay [-p profile.csv] record.bin [audio_out.raw [fm_out.raw]]
+ */
+
+#include "dsp.h"
+#include "rig.h"
+#include "record.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Largest block in a recording
+#define BLOCK_MAXLEN 64
+// CPU cycles per audio sample on the device
+#define CYCLES_PER_SAMPLE (38400000 / TX_FS)
+
+rig_parameters_t p = { 0 };
+rig_status_t rs = { 0 };
+
+struct profile {
+	const char *name;
+	unsigned blocks, differ, first_differ, over_budget;
+	uint64_t cycles;
+	uint32_t cycles_min, cycles_max, max_block;
+	uint64_t host_ns, host_ns_max;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+static void profile_block(struct profile *pr, unsigned block,
+	const struct record_block *b, uint32_t hash, uint64_t host_ns)
+{
+	if (hash != b->out_hash) {
+		if (pr->differ == 0)
+			pr->first_differ = block;
+		pr->differ++;
+	}
+	if (pr->blocks == 0 || b->cycles < pr->cycles_min)
+		pr->cycles_min = b->cycles;
+	if (b->cycles > pr->cycles_max) {
+		pr->cycles_max = b->cycles;
+		pr->max_block = block;
+	}
+	if (b->cycles > (uint32_t)b->out_len * CYCLES_PER_SAMPLE)
+		pr->over_budget++;
+	pr->cycles += b->cycles;
+	pr->host_ns += host_ns;
+	if (host_ns > pr->host_ns_max)
+		pr->host_ns_max = host_ns;
+	pr->blocks++;
+}
+
+static void profile_print(const struct profile *pr, unsigned block_len)
+{
+	if (pr->blocks == 0)
+		return;
+	double avg = (double)pr->cycles / pr->blocks;
+	printf("%s: %u blocks, %u differ", pr->name, pr->blocks, pr->differ);
+	if (pr->differ > 0)
+		printf(" (first at block %u)", pr->first_differ);
+	printf("\n  device: %u / %.0f / %u cycles min / avg / max (max at block %u)\n",
+		pr->cycles_min, avg, pr->cycles_max, pr->max_block);
+	printf("          %.1f %% of real time on average, %u blocks over\n",
+		100.0 * avg / (block_len * CYCLES_PER_SAMPLE), pr->over_budget);
+	printf("  host:   %.0f / %llu ns avg / max\n",
+		(double)pr->host_ns / pr->blocks, (unsigned long long)pr->host_ns_max);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-p profile.csv] record.bin [audio_out.raw [fm_out.raw]]\n", name);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *fnames[3] = { NULL, NULL, NULL };
+	FILE *profile_file = NULL;
+	int i, nf = 0;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			profile_file = fopen(argv[++i], "w");
+			if (profile_file == NULL) {
+				perror(argv[i]);
+				return 2;
+			}
+			fprintf(profile_file, "block,type,start_cycles,cycles,host_ns\n");
+		} else if (nf < 3) {
+			fnames[nf++] = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (fnames[0] == NULL)
+		usage(argv[0]);
+	FILE *f = fopen(fnames[0], "rb");
+	if (f == NULL) {
+		perror(fnames[0]);
+		return 2;
+	}
+	FILE *audio_out_file = NULL, *fm_out_file = NULL;
+	if (fnames[1] != NULL && (audio_out_file = fopen(fnames[1], "wb")) == NULL) {
+		perror(fnames[1]);
+		return 2;
+	}
+	if (fnames[2] != NULL && (fm_out_file = fopen(fnames[2], "wb")) == NULL) {
+		perror(fnames[2]);
+		return 2;
+	}
+
+	struct profile rx = { .name = "RX" }, tx = { .name = "TX" };
+	unsigned rx_len = 0, tx_len = 0, blocks = 0, params = 0, restarts = 0;
+	int started = 0;
+
+	struct record_header h;
+	union {
+		struct record_start start;
+		struct dsp_params params;
+		struct {
+			struct record_block b;
+			union {
+				iq_in_t iq[BLOCK_MAXLEN];
+				audio_in_t audio[BLOCK_MAXLEN];
+			};
+		} block;
+	} r;
+	while (fread(&h, sizeof(h), 1, f) == 1) {
+		if (h.magic != RECORD_MAGIC || h.len > sizeof(r)) {
+			fprintf(stderr, "Bad record after block %u\n", blocks);
+			return 2;
+		}
+		if (h.len > 0 && fread(&r, h.len, 1, f) != 1)
+			break;
+
+		if (!started && h.type != RECORD_START) {
+			fprintf(stderr, "Recording does not start from boot\n");
+			return 2;
+		}
+		switch (h.type) {
+		case RECORD_START:
+			if (r.start.version != RECORD_VERSION
+				|| r.start.params_size != sizeof(struct dsp_params)) {
+				fprintf(stderr, "Recording is from a different version\n");
+				return 2;
+			}
+			started = 1;
+			break;
+		case RECORD_PARAMS:
+			dsp_set_params(&r.params);
+			params++;
+			break;
+		case RECORD_SQUELCH_RESTART:
+			dsp_squelch_restart();
+			restarts++;
+			break;
+		case RECORD_RX: {
+			audio_out_t out[BLOCK_MAXLEN];
+			struct record_block *b = &r.block.b;
+			if (b->in_len > BLOCK_MAXLEN || b->out_len > BLOCK_MAXLEN) {
+				fprintf(stderr, "Bad block %u\n", blocks);
+				return 2;
+			}
+			uint64_t t = now_ns();
+			dsp_fast_rx(r.block.iq, b->in_len, out, b->out_len);
+			t = now_ns() - t;
+			profile_block(&rx, blocks, b, record_hash(out, b->out_len * sizeof(*out)), t);
+			rx_len = b->out_len;
+			if (audio_out_file != NULL)
+				(void)fwrite(out, sizeof(*out), b->out_len, audio_out_file);
+			if (profile_file != NULL)
+				fprintf(profile_file, "%u,RX,%u,%u,%llu\n", blocks,
+					h.cycles, b->cycles, (unsigned long long)t);
+			blocks++;
+			break;
+		}
+		case RECORD_TX: {
+			fm_out_t out[BLOCK_MAXLEN];
+			struct record_block *b = &r.block.b;
+			if (b->in_len > BLOCK_MAXLEN || b->out_len != b->in_len) {
+				fprintf(stderr, "Bad block %u\n", blocks);
+				return 2;
+			}
+			uint64_t t = now_ns();
+			dsp_fast_tx(r.block.audio, out, b->in_len);
+			t = now_ns() - t;
+			profile_block(&tx, blocks, b, record_hash(out, b->out_len * sizeof(*out)), t);
+			tx_len = b->out_len;
+			if (fm_out_file != NULL)
+				(void)fwrite(out, sizeof(*out), b->out_len, fm_out_file);
+			if (profile_file != NULL)
+				fprintf(profile_file, "%u,TX,%u,%u,%llu\n", blocks,
+					h.cycles, b->cycles, (unsigned long long)t);
+			blocks++;
+			break;
+		}
+		default:
+			fprintf(stderr, "Unknown record type %u\n", (unsigned)h.type);
+			return 2;
+		}
+	}
+	fclose(f);
+	if (audio_out_file != NULL)
+		fclose(audio_out_file);
+	if (fm_out_file != NULL)
+		fclose(fm_out_file);
+	if (profile_file != NULL)
+		fclose(profile_file);
+
+	printf("%u blocks, %u parameter changes, %u squelch restarts\n",
+		blocks, params, restarts);
+	profile_print(&rx, rx_len);
+	profile_print(&tx, tx_len);
+	return rx.differ > 0 || tx.differ > 0;
+}
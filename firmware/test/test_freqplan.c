@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: MIT */
+/* Test that the frequency plan table lookup gives the same result
+ * as the brute force divider search at every frequency step.
+ * Build and run with: make check_freqplan */
+
+#include <stdio.h>
+#include "freqplan.h"
+#include "../tools/freqplan_search.h"
+
+#ifdef KAPULA_v2
+#define VERSION 2
+#else
+#define VERSION 1
+#endif
+
+int main(void)
+{
+	uint32_t f, errors = 0;
+	for (f = 0; f < (1UL << (32 - FREQPLAN_SHIFT)); f++) {
+		uint32_t ratio;
+		uint32_t divider = freqplan_search(f, VERSION, &ratio);
+		uint32_t freq = f << FREQPLAN_SHIFT;
+		const struct freqplan_range *r = freqplan_lookup(freq | ((1UL << FREQPLAN_SHIFT) - 1));
+		if (r != freqplan_lookup(freq)
+			|| r->divider != divider
+			|| r->ratio != ratio
+			|| r->pa_2g4 != (divider == 1)
+			|| freqplan_tunable(freq) != (divider != 0)) {
+			if (errors < 10)
+				printf("Mismatch at %10u Hz: %03x %3u, table %03x %3u\n",
+					(unsigned)freq, (unsigned)divider, (unsigned)ratio,
+					r->divider, r->ratio);
+			errors++;
+		}
+	}
+	printf("v%d: %u ranges, %u mismatches\n",
+		VERSION, freqplan_table_len, (unsigned)errors);
+	return errors != 0;
+}
@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: MIT */
+/* Decode a signal capture into WAV files.
+ *
+ * Capture the stream from a firmware built with CAPTURE=1, e.g.
+ *     openocd -f openocd/rtt.cfg
+ *     nc localhost 4447 > capture.bin
+ * after selecting a tap by writing capture.tap from a debugger,
+ * and decode it with
+ *     ./capture_decode capture.bin
+ *
+ * Each tap in the stream is written to capture_<tap>.wav.
+ * Integer taps become 16-bit PCM and floating point taps
+ * become 32-bit float with the values the DSP code saw.
+ * Received I/Q is also written to capture_rx_iq.raw in the
+ * iq_in_t format of dsp.h, which can be fed to dsp_fast_rx
+ * in host tests.
+ *
+ * Dropped blocks are filled with zeros so the files keep
+ * their timing. The number of dropped blocks and the sample
+ * rate achieved are printed for each tap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "../inc/capture.h"
+
+static const char *const tap_names[CAPTURE_TAPS] = {
+	[CAPTURE_OFF] = "off",
+	[CAPTURE_RX_IQ] = "rx_iq",
+	[CAPTURE_RX_MIXED] = "rx_mixed",
+	[CAPTURE_RX_DEMOD] = "rx_demod",
+	[CAPTURE_RX_AUDIO] = "rx_audio",
+	[CAPTURE_TX_MIC] = "tx_mic",
+};
+
+#define TAP_IS_FLOAT(tap) ((tap) == CAPTURE_RX_MIXED || (tap) == CAPTURE_RX_DEMOD)
+
+struct tap_output {
+	FILE *wav, *raw;
+	unsigned blocks, dropped;
+	// Frames written, including zeros for dropped blocks
+	uint64_t frames;
+	// Frames and time after the first block, to calculate the rate
+	uint64_t rate_frames, first_cycles, last_cycles;
+	// Bytes received and bytes the same samples take as raw 16-bit
+	uint64_t bytes, raw_bytes;
+};
+
+static struct tap_output taps[CAPTURE_TAPS];
+static const char *prefix = "capture";
+
+static void put_u16(FILE *f, uint16_t v)
+{
+	fputc(v & 0xFF, f);
+	fputc(v >> 8, f);
+}
+
+static void put_u32(FILE *f, uint32_t v)
+{
+	put_u16(f, v & 0xFFFF);
+	put_u16(f, v >> 16);
+}
+
+/* Write a WAV header. It is written again with the sizes
+ * once everything has been written. */
+static void wav_header(FILE *f, unsigned tap, uint64_t frames)
+{
+	unsigned channels = CAPTURE_TAP_IS_IQ(tap) ? 2 : 1;
+	unsigned bytes = TAP_IS_FLOAT(tap) ? 4 : 2;
+	unsigned fs = CAPTURE_TAP_FS(tap);
+	uint32_t data_len = frames * channels * bytes;
+	fseek(f, 0, SEEK_SET);
+	fwrite("RIFF", 4, 1, f);
+	put_u32(f, 36 + data_len);
+	fwrite("WAVEfmt ", 8, 1, f);
+	put_u32(f, 16);
+	// 3 is IEEE float, 1 is PCM
+	put_u16(f, TAP_IS_FLOAT(tap) ? 3 : 1);
+	put_u16(f, channels);
+	put_u32(f, fs);
+	put_u32(f, fs * channels * bytes);
+	put_u16(f, channels * bytes);
+	put_u16(f, bytes * 8);
+	fwrite("data", 4, 1, f);
+	put_u32(f, data_len);
+}
+
+static FILE *open_output(unsigned tap, const char *ext)
+{
+	char name[256];
+	snprintf(name, sizeof(name), "%s_%s.%s", prefix, tap_names[tap], ext);
+	FILE *f = fopen(name, "wb");
+	if (f == NULL) {
+		perror(name);
+		exit(1);
+	}
+	return f;
+}
+
+static int16_t mulaw_decode(uint8_t u)
+{
+	u = ~u;
+	int segment = (u >> 4) & 7, mantissa = u & 0x0F;
+	int v = (((mantissa << 3) + 0x84) << segment) - 0x84;
+	return (u & 0x80) ? -v : v;
+}
+
+static int16_t clamp16(float v)
+{
+	if (v > 32767.0f)
+		return 32767;
+	if (v < -32768.0f)
+		return -32768;
+	return (int16_t)v;
+}
+
+/* Write n decoded values of a tap */
+static void write_values(unsigned tap, const float *v, unsigned n)
+{
+	struct tap_output *t = &taps[tap];
+	unsigned i;
+	for (i = 0; i < n; i++) {
+		if (TAP_IS_FLOAT(tap)) {
+			fwrite(&v[i], 4, 1, t->wav);
+		} else {
+			put_u16(t->wav, clamp16(v[i]));
+		}
+	}
+	if (t->raw != NULL) {
+		// iq_in_t has Q first
+		for (i = 0; i + 1 < n; i += 2) {
+			put_u16(t->raw, clamp16(v[i+1]));
+			put_u16(t->raw, clamp16(v[i]));
+		}
+	}
+	t->frames += CAPTURE_TAP_IS_IQ(tap) ? n / 2 : n;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-f cpu_clock_hz] [-o prefix] capture.bin\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *fname = NULL;
+	double cpu_hz = 38.4e6;
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			cpu_hz = atof(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			prefix = argv[++i];
+		else if (fname == NULL)
+			fname = argv[i];
+		else
+			usage(argv[0]);
+	}
+	if (fname == NULL || cpu_hz <= 0)
+		usage(argv[0]);
+	FILE *f = fopen(fname, "rb");
+	if (f == NULL) {
+		perror(fname);
+		return 1;
+	}
+
+	// Cycle counter extended to 64 bits
+	uint64_t now = 0;
+	uint32_t prev_cycles = 0;
+	uint16_t prev_seq = 0;
+	int have_block = 0;
+	// Tap of the previous block, to fill dropped blocks
+	unsigned prev_tap = CAPTURE_OFF;
+	unsigned blocks = 0, dropped = 0, skipped_bytes = 0;
+	uint64_t total_bytes = 0;
+
+	struct capture_header h;
+	uint8_t data[CAPTURE_MAXLEN * 2];
+	float values[CAPTURE_MAXLEN];
+	int c;
+	while ((c = fgetc(f)) != EOF) {
+		// Look for the start of a block
+		if (c != CAPTURE_MAGIC) {
+			skipped_bytes++;
+			continue;
+		}
+		h.magic = c;
+		if (fread((uint8_t*)&h + 1, sizeof(h) - 1, 1, f) != 1)
+			break;
+		if (h.tap == CAPTURE_OFF || h.tap >= CAPTURE_TAPS
+			|| h.codec >= CAPTURE_CODECS || h.n > CAPTURE_MAXLEN) {
+			// Not a block, continue looking after the magic byte
+			skipped_bytes++;
+			fseek(f, 1 - (long)sizeof(h), SEEK_CUR);
+			continue;
+		}
+		unsigned len = h.codec == CAPTURE_RAW16 ? h.n * 2 : h.n;
+		if (fread(data, len, 1, f) != 1)
+			break;
+
+		float scale = ldexpf(1.0f, h.exponent);
+		unsigned n;
+		for (n = 0; n < h.n; n++) {
+			int v;
+			if (h.codec == CAPTURE_RAW16)
+				v = (int16_t)(data[2*n] | (data[2*n+1] << 8));
+			else if (h.codec == CAPTURE_BFP8)
+				v = (int8_t)data[n];
+			else
+				v = mulaw_decode(data[n]);
+			values[n] = v * scale;
+		}
+
+		struct tap_output *t = &taps[h.tap];
+		if (t->wav == NULL) {
+			t->wav = open_output(h.tap, "wav");
+			wav_header(t->wav, h.tap, 0);
+			if (h.tap == CAPTURE_RX_IQ)
+				t->raw = open_output(h.tap, "raw");
+		}
+
+		if (have_block) {
+			now += (uint32_t)(h.cycles - prev_cycles);
+			/* The firmware sends one tap at a time, so blocks lost
+			 * between two blocks of the same tap were of that tap. */
+			unsigned lost = (uint16_t)(h.seq - prev_seq - 1);
+			dropped += lost;
+			t->dropped += lost;
+			if (h.tap == prev_tap) {
+				static const float zeros[CAPTURE_MAXLEN];
+				for (n = 0; n < lost; n++)
+					write_values(h.tap, zeros, h.n);
+			}
+		}
+		if (t->blocks == 0) {
+			t->first_cycles = now;
+		} else {
+			t->rate_frames += CAPTURE_TAP_IS_IQ(h.tap) ? h.n / 2 : h.n;
+		}
+		t->last_cycles = now;
+		t->blocks++;
+		t->bytes += sizeof(h) + len;
+		t->raw_bytes += h.n * 2;
+		write_values(h.tap, values, h.n);
+
+		prev_cycles = h.cycles;
+		prev_seq = h.seq;
+		prev_tap = h.tap;
+		have_block = 1;
+		blocks++;
+		total_bytes += sizeof(h) + len;
+	}
+	fclose(f);
+
+	double seconds = now / cpu_hz;
+	for (i = 0; i < CAPTURE_TAPS; i++) {
+		struct tap_output *t = &taps[i];
+		if (t->wav == NULL)
+			continue;
+		wav_header(t->wav, i, t->frames);
+		fclose(t->wav);
+		if (t->raw != NULL)
+			fclose(t->raw);
+		double span = (t->last_cycles - t->first_cycles) / cpu_hz;
+		fprintf(stderr, "%s: %u blocks, %u dropped, %.0f of %u Hz, %.0f%% of raw size\n",
+			tap_names[i], t->blocks, t->dropped,
+			span > 0 ? t->rate_frames / span : 0.0, CAPTURE_TAP_FS(i),
+			t->raw_bytes ? 100.0 * t->bytes / t->raw_bytes : 0.0);
+	}
+	fprintf(stderr, "%u blocks, %u dropped, %u bytes skipped, %.3f s, %.0f bytes/s\n",
+		blocks, dropped, skipped_bytes, seconds,
+		seconds > 0 ? total_bytes / seconds : 0.0);
+	return 0;
+}
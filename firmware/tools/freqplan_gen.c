@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: MIT */
+/* Generate the frequency plan table, src/freqplan_table.c.
+ * Build and run with make in this directory. */
+
+#include <stdio.h>
+#include "../inc/freqplan.h"
+#include "freqplan_search.h"
+
+static void print_table(int v)
+{
+	uint32_t f, prev_divider = 0xFFFFFFFF;
+	for (f = 0; f < (1UL << (32 - FREQPLAN_SHIFT)); f++) {
+		uint32_t ratio;
+		uint32_t divider = freqplan_search(f, v, &ratio);
+		if (divider == prev_divider)
+			continue;
+		printf("\t{ 0x%06x, 0x%03x, %3u, %u }, // %9.4f MHz\n",
+			(unsigned)f, (unsigned)divider, (unsigned)ratio,
+			divider == 1,
+			(double)((uint64_t)f << FREQPLAN_SHIFT) * 1e-6);
+		prev_divider = divider;
+	}
+}
+
+int main(void)
+{
+	printf(
+		"/* SPDX-License-Identifier: MIT */\n"
+		"/* Generated by tools/freqplan_gen. Do not edit. */\n"
+		"\n"
+		"#include \"freqplan.h\"\n"
+		"\n"
+		"const struct freqplan_range freqplan_table[] = {\n"
+		"#ifdef KAPULA_v2\n");
+	print_table(2);
+	printf("#else\n");
+	print_table(1);
+	printf(
+		"#endif\n"
+		"};\n"
+		"\n"
+		"const unsigned freqplan_table_len =\n"
+		"\tsizeof(freqplan_table) / sizeof(freqplan_table[0]);\n");
+	return 0;
+}
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef TOOLS_FREQPLAN_SEARCH_H_
+#define TOOLS_FREQPLAN_SEARCH_H_
+
+/* Brute force search of VCO frequency dividers.
+ * This used to be done in the firmware on every tune.
+ * Now it is only used to generate the frequency plan table
+ * and to test the table lookup against it. */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Find suitable VCO frequency dividers for a given frequency
+ * shifted right by FREQPLAN_SHIFT, for hardware version v (1 or 2).
+ * Return 0 if no possible combination was found. */
+static inline uint32_t freqplan_search(uint32_t f, int v, uint32_t *ratio)
+{
+	// All frequencies are shifted right by 10 so they fit in 32 bits
+	// even after multiplying by all possible divider values.
+	// Find divider values that get VCO frequency closest to
+	// the approximate middle of its tuning range, vco_mid.
+	const int32_t vco_mid = (int32_t)(2600000000UL >> 10);
+	// Smallest distance from vco_mid found.
+	// Initial value determines the maximum allowed distance + 1.
+	// If no divider values getting closer than that are found,
+	// d1m, d2m and d3m will stay 0 and the function will return 0.
+	int32_t dmin = (int32_t)(600000000UL >> 10) + 1;
+	// Divider values from the combination that achieves dmin.
+	uint32_t d1m = 0, d2m = 0, d3m = 0;
+	uint32_t d1, d2, d3;
+	// v1 seems to crash on some frequencies below 23 MHz.
+	// It's mostly useless on lower frequencies anyway,
+	// so just limit the tuning range by not allowing d1=5.
+	const uint32_t d1max = v == 2 ? 5 : 4;
+	for (d1 = 1; d1 <= d1max; d1++) {
+		for (d2 = 1; d2 <= 5; d2++) {
+			// Try values 1, 2, 3, 4, 5, 7 for d3.
+			// 7 isn't supported by the older chip.
+			for (d3 = 1; d3 <= (v == 2 ? 6u : 5u); d3++) {
+				if (d3 == 6) d3 = 7;
+				// VCO frequency with these divider values
+				int32_t vco = (int32_t)f * d1 * d2 * d3;
+				// Distance from middle of VCO tuning range
+				int32_t d = abs(vco - vco_mid);
+				if (d < dmin) {
+					dmin = d;
+					d1m = d1;
+					d2m = d2;
+					d3m = d3;
+				}
+			}
+		}
+	}
+	*ratio = d1m * d2m * d3m;
+	if (d1m == 1) d1m = 0;
+	if (d2m == 1) d2m = 0;
+	return (d1m << 6) | (d2m << 3) | d3m;
+}
+
+#endif /* TOOLS_FREQPLAN_SEARCH_H_ */
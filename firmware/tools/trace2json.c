@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: MIT */
+/* Convert a binary RTOS trace to Chrome trace event JSON.
+ *
+ * Capture the trace from a firmware built with TRACE=1, e.g.
+ *     openocd -f openocd/rtt.cfg
+ *     nc localhost 4446 > trace.bin
+ * and convert it with
+ *     ./trace2json trace.bin > trace.json
+ * Open the result in chrome://tracing or https://ui.perfetto.dev/.
+ *
+ * Each task and each interrupt gets its own row.
+ * Queue sends, semaphore gives and task notifications are shown
+ * as instant events on the row of whatever was running.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../inc/trace.h"
+
+// Row numbers of interrupts, after those of tasks
+#define ISR_TID 1000
+// Deepest interrupt nesting tracked
+#define ISR_NEST_MAX 8
+// Longest task name
+#define NAME_MAX_LEN 32
+
+static const char *const isr_names[] = {
+	[TRACE_ISR_RAIL] = "RAIL callback",
+	[TRACE_ISR_SAMPLE_TIMER] = "Sample timer",
+	[TRACE_ISR_DISPLAY_DMA] = "Display DMA",
+	[TRACE_ISR_UI_GPIO] = "UI GPIO",
+};
+
+/* Names of queue types in FreeRTOS queue.h */
+static const char *const queue_type_names[] = {
+	"queue", "mutex", "counting semaphore", "semaphore", "recursive mutex",
+};
+
+#define N_ISRS (sizeof(isr_names) / sizeof(isr_names[0]))
+#define N_QUEUE_TYPES (sizeof(queue_type_names) / sizeof(queue_type_names[0]))
+
+static const char *isr_name(unsigned isr)
+{
+	return isr < N_ISRS ? isr_names[isr] : "Interrupt";
+}
+
+static const char *queue_type_name(unsigned type)
+{
+	return type < N_QUEUE_TYPES ? queue_type_names[type] : "queue";
+}
+
+static double cycles_per_us = 38.4;
+static int first_event = 1;
+
+static void event_begin(void)
+{
+	printf("%s\n", first_event ? "" : ",");
+	first_event = 0;
+}
+
+static void thread_name(int tid, const char *name)
+{
+	event_begin();
+	printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+		"\"args\":{\"name\":\"%s\"}}", tid, name);
+}
+
+static void duration(char ph, int tid, const char *name, uint64_t cycles)
+{
+	event_begin();
+	printf("{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}",
+		name, ph, tid, (double)cycles / cycles_per_us);
+}
+
+static void instant(int tid, const char *what, const char *name, unsigned n, uint64_t cycles)
+{
+	event_begin();
+	printf("{\"name\":\"%s %s %u\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}",
+		what, name, n, tid, (double)cycles / cycles_per_us);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-f cpu_clock_hz] trace.bin > trace.json\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *fname = NULL;
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			cycles_per_us = atof(argv[++i]) * 1e-6;
+		else if (fname == NULL)
+			fname = argv[i];
+		else
+			usage(argv[0]);
+	}
+	if (fname == NULL || cycles_per_us <= 0)
+		usage(argv[0]);
+	FILE *f = fopen(fname, "rb");
+	if (f == NULL) {
+		perror(fname);
+		return 1;
+	}
+
+	// Cycle counter extended to 64 bits
+	uint64_t now = 0;
+	uint32_t prev_cycles = 0;
+	int have_time = 0;
+	// Task running, -1 if none seen yet
+	int task = -1;
+	// Interrupts running, innermost last
+	int isr_stack[ISR_NEST_MAX], isr_depth = 0;
+	char task_names[256][NAME_MAX_LEN + 1];
+	unsigned records = 0, dropped = 0;
+	memset(task_names, 0, sizeof(task_names));
+
+	printf("{\"traceEvents\":[");
+	for (i = 0; i < (int)N_ISRS; i++)
+		thread_name(ISR_TID + i, isr_names[i]);
+
+	struct trace_record r;
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		records++;
+		if (have_time)
+			now += (uint32_t)(r.cycles - prev_cycles);
+		prev_cycles = r.cycles;
+		have_time = 1;
+		// Row of whatever is running
+		int tid = isr_depth > 0 ? ISR_TID + isr_stack[isr_depth - 1] : task;
+
+		switch (r.type) {
+		case TRACE_TASK_NAME: {
+			char name[NAME_MAX_LEN] = { 0 };
+			unsigned len = (r.arg + sizeof(r) - 1) & ~(sizeof(r) - 1);
+			if (len > sizeof(name) || fread(name, len, 1, f) != 1) {
+				fprintf(stderr, "Bad task name record\n");
+				goto done;
+			}
+			snprintf(task_names[r.id], sizeof(task_names[r.id]), "%.*s", r.arg, name);
+			thread_name(r.id, task_names[r.id]);
+			break;
+		}
+		case TRACE_TASK_SWITCH:
+			if ((int)r.id == task)
+				break;
+			if (task >= 0)
+				duration('E', task, task_names[task], now);
+			task = r.id;
+			duration('B', task, task_names[task], now);
+			break;
+		case TRACE_ISR_ENTER:
+			if (isr_depth < ISR_NEST_MAX)
+				isr_stack[isr_depth++] = r.id;
+			duration('B', ISR_TID + r.id, isr_name(r.id), now);
+			break;
+		case TRACE_ISR_EXIT:
+			if (isr_depth > 0)
+				isr_depth--;
+			duration('E', ISR_TID + r.id, isr_name(r.id), now);
+			break;
+		case TRACE_QUEUE_CREATE:
+			break;
+		case TRACE_QUEUE_SEND:
+			instant(tid, r.arg == 0 ? "send" : "give",
+				queue_type_name(r.arg), r.id, now);
+			break;
+		case TRACE_QUEUE_SEND_FAILED:
+			instant(tid, r.arg == 0 ? "FAILED send" : "FAILED give",
+				queue_type_name(r.arg), r.id, now);
+			break;
+		case TRACE_NOTIFY:
+			instant(tid, "notify", "task", r.id, now);
+			break;
+		case TRACE_DROPPED:
+			dropped += r.arg;
+			event_begin();
+			printf("{\"name\":\"%u records dropped\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}",
+				(unsigned)r.arg, (double)now / cycles_per_us);
+			break;
+		default:
+			fprintf(stderr, "Unknown record type %u\n", (unsigned)r.type);
+			goto done;
+		}
+	}
+done:
+	printf("\n]}\n");
+	fclose(f);
+	fprintf(stderr, "%u records, %u dropped, %.3f s\n",
+		records, dropped, (double)now / cycles_per_us * 1e-6);
+	return 0;
+}